@@ -28,6 +28,7 @@
 /* #define JANET_NO_PEG */
 /* #define JANET_NO_NET */
 /* #define JANET_NO_INT_TYPES */
+/* #define JANET_NO_TYPED_ARRAY */
 /* #define JANET_NO_EV */
 /* #define JANET_NO_REALPATH */
 /* #define JANET_NO_SYMLINKS */
@@ -36,7 +37,7 @@
 
 /* Other settings */
 /* #define JANET_DEBUG */
-/* #define JANET_PRF */
+/* #define JANET_PRF */ /* Hash strings with halfsiphash instead of wyhash */
 /* #define JANET_NO_UTC_MKTIME */
 /* #define JANET_OUT_OF_MEMORY do { printf("janet out of memory\n"); exit(1); } while (0) */
 /* #define JANET_EXIT(msg) do { printf("C assert failed executing janet: %s\n", msg); exit(1); } while (0) */
@@ -23,6 +23,7 @@
 #ifndef JANET_AMALG
 #include "features.h"
 #include <janet.h>
+#include "compile.h"
 #include "gc.h"
 #include "util.h"
 #include "state.h"
@@ -343,6 +344,445 @@ JANET_CORE_FN(cfun_array_clear,
     return argv[0];
 }
 
+/*
+ * Sorting. Elements are sorted as key/value pairs ordered by key, so sort-by
+ * calls its key function once per element instead of once per comparison.
+ * Plain sorts use each element as its own key.
+ */
+
+JanetSortOrder janet_getsortorder(const Janet *argv, int32_t argc, int32_t n) {
+    JanetSortOrder order;
+    order.kind = JANET_SORT_LT;
+    order.before = janet_wrap_nil();
+    if (argc > n && !janet_checktype(argv[n], JANET_NIL)) {
+        Janet f = argv[n];
+        uint32_t tag = janet_checktype(f, JANET_FUNCTION)
+                       ? janet_unwrap_function(f)->def->flags & JANET_FUNCDEF_FLAG_TAG
+                       : 0;
+        if (tag == JANET_FUN_LT) {
+            order.kind = JANET_SORT_LT;
+        } else if (tag == JANET_FUN_GT) {
+            order.kind = JANET_SORT_GT;
+        } else {
+            order.kind = JANET_SORT_CALL;
+            order.before = f;
+        }
+    }
+    return order;
+}
+
+/* Same as the < function */
+static int sort_less(Janet x, Janet y) {
+    if (janet_checktype(x, JANET_NUMBER) && janet_checktype(y, JANET_NUMBER)) {
+        return janet_unwrap_number(x) < janet_unwrap_number(y);
+    }
+    return janet_compare(x, y) < 0;
+}
+
+int janet_sort_before(const JanetSortOrder *order, Janet x, Janet y) {
+    switch (order->kind) {
+        case JANET_SORT_LT:
+            return sort_less(x, y);
+        case JANET_SORT_GT:
+            return sort_less(y, x);
+        default: {
+            Janet args[2] = {x, y};
+            return janet_truthy(janet_call_value(order->before, 2, args));
+        }
+    }
+}
+
+static int sort_before(const JanetSortOrder *order, const JanetKV *x, const JanetKV *y) {
+    int before = janet_sort_before(order, x->key, y->key);
+    if (order->kind == JANET_SORT_CALL) janet_gccheck();
+    return before;
+}
+
+#define JANET_SORT_SMALL 16
+
+static void sort_insertion(JanetKV *a, int32_t n, const JanetSortOrder *order) {
+    for (int32_t i = 1; i < n; i++) {
+        JanetKV x = a[i];
+        int32_t j = i;
+        while (j > 0 && sort_before(order, &x, a + j - 1)) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = x;
+    }
+}
+
+static void sort_sift(JanetKV *a, int32_t root, int32_t n, const JanetSortOrder *order) {
+    JanetKV x = a[root];
+    for (;;) {
+        int32_t child = 2 * root + 1;
+        if (child >= n) break;
+        if (child + 1 < n && sort_before(order, a + child, a + child + 1)) child++;
+        if (!sort_before(order, &x, a + child)) break;
+        a[root] = a[child];
+        root = child;
+    }
+    a[root] = x;
+}
+
+static void sort_heap(JanetKV *a, int32_t n, const JanetSortOrder *order) {
+    for (int32_t i = n / 2 - 1; i >= 0; i--) sort_sift(a, i, n, order);
+    for (int32_t i = n - 1; i > 0; i--) {
+        JanetKV tmp = a[0];
+        a[0] = a[i];
+        a[i] = tmp;
+        sort_sift(a, 0, i, order);
+    }
+}
+
+/* Introsort - quicksort that falls back to heapsort when partitions keep
+ * coming out lopsided. The scans are bounds checked so that a comparator
+ * that is not a strict ordering can only produce an odd order. */
+static void sort_intro(JanetKV *a, int32_t n, int depth, const JanetSortOrder *order) {
+    while (n > JANET_SORT_SMALL) {
+        if (depth-- == 0) {
+            sort_heap(a, n, order);
+            return;
+        }
+        /* Move the median of three to the front as the pivot */
+        JanetKV *lo = a, *mid = a + n / 2, *hi = a + n - 1, *m;
+        if (sort_before(order, lo, mid)) {
+            m = sort_before(order, mid, hi) ? mid : (sort_before(order, lo, hi) ? hi : lo);
+        } else {
+            m = sort_before(order, lo, hi) ? lo : (sort_before(order, mid, hi) ? hi : mid);
+        }
+        JanetKV pivot = *m;
+        *m = a[0];
+        a[0] = pivot;
+        int32_t i = 0, j = n;
+        for (;;) {
+            do i++; while (i < n && sort_before(order, a + i, &pivot));
+            do j--; while (j > 0 && sort_before(order, &pivot, a + j));
+            if (i >= j) break;
+            JanetKV tmp = a[i];
+            a[i] = a[j];
+            a[j] = tmp;
+        }
+        a[0] = a[j];
+        a[j] = pivot;
+        /* Recurse into the smaller side to bound stack depth */
+        if (j < n - j - 1) {
+            sort_intro(a, j, depth, order);
+            a += j + 1;
+            n -= j + 1;
+        } else {
+            sort_intro(a + j + 1, n - j - 1, depth, order);
+            n = j;
+        }
+    }
+    sort_insertion(a, n, order);
+}
+
+/* Bottom up merge sort, for stable sorts */
+static void sort_merge(JanetKV *a, JanetKV *tmp, int32_t n, const JanetSortOrder *order) {
+    for (int32_t i = 0; i < n; i += JANET_SORT_SMALL) {
+        sort_insertion(a + i, (n - i < JANET_SORT_SMALL) ? n - i : JANET_SORT_SMALL, order);
+    }
+    for (int32_t width = JANET_SORT_SMALL; width < n; width *= 2) {
+        for (int32_t lo = 0; lo < n - width; lo += 2 * width) {
+            int32_t mid = lo + width;
+            int32_t hi = (n - mid < width) ? n : mid + width;
+            int32_t i = lo, j = mid, k = 0;
+            while (i < mid && j < hi) {
+                tmp[k++] = sort_before(order, a + j, a + i) ? a[j++] : a[i++];
+            }
+            while (i < mid) tmp[k++] = a[i++];
+            while (j < hi) tmp[k++] = a[j++];
+            memcpy(a + lo, tmp, k * sizeof(JanetKV));
+        }
+    }
+}
+
+typedef struct {
+    JanetArray *array;
+    JanetArray *scratch;
+    Janet keyfn;
+    const JanetSortOrder *order;
+    int stable;
+} JanetSortState;
+
+static void janet_sort_run(void *data) {
+    JanetSortState *state = (JanetSortState *) data;
+    JanetArray *array = state->array;
+    int32_t n = state->scratch->count / (state->stable ? 6 : 4);
+    /* The first 2n slots keep every key and value reachable while the
+     * entries after them are being moved around by the sort. */
+    Janet *keep = state->scratch->data;
+    JanetKV *items = (JanetKV *)(keep + 2 * n);
+    /* Copy the elements first, since the key function may change the array */
+    for (int32_t i = 0; i < n; i++) {
+        keep[2 * i] = keep[2 * i + 1] = array->data[i];
+    }
+    if (!janet_checktype(state->keyfn, JANET_NIL)) {
+        for (int32_t i = 0; i < n; i++) {
+            keep[2 * i] = janet_call_value(state->keyfn, 1, keep + 2 * i + 1);
+            janet_gccheck();
+        }
+    }
+    for (int32_t i = 0; i < n; i++) {
+        items[i].key = keep[2 * i];
+        items[i].value = keep[2 * i + 1];
+    }
+    if (state->stable) {
+        sort_merge(items, items + n, n, state->order);
+    } else {
+        int depth = 0;
+        for (int32_t m = n; m > 1; m >>= 1) depth += 2;
+        sort_intro(items, n, depth, state->order);
+    }
+    janet_array_ensure(array, n, 1);
+    array->count = n;
+    for (int32_t i = 0; i < n; i++) array->data[i] = items[i].value;
+}
+
+/* Sort an array in place. If keyfn is not nil, elements are sorted by the
+ * results of calling it on each element. Comparators and key functions may
+ * run arbitrary code, including code that changes the array, so the sort
+ * works on a rooted scratch array and lets the collector run between
+ * calls. */
+static void janet_sort_array(JanetArray *array, Janet keyfn, const JanetSortOrder *order, int stable) {
+    int32_t n = array->count;
+    if (n < 2) return;
+    int32_t size = (stable ? 6 : 4);
+    if (n > INT32_MAX / size) janet_panic("array too large to sort");
+    JanetSortState state;
+    state.array = array;
+    state.scratch = janet_array(n * size);
+    for (int32_t i = 0; i < n * size; i++) state.scratch->data[i] = janet_wrap_nil();
+    state.scratch->count = n * size;
+    state.keyfn = keyfn;
+    state.order = order;
+    state.stable = stable;
+    /* The array may be new, as in sorted, so root it with the scratch */
+    Janet roots[2] = {janet_wrap_array(state.scratch), janet_wrap_array(array)};
+    janet_gcrooted(roots, 2, janet_sort_run, &state);
+}
+
+/* Sort any mutable indexed value in place. Values other than arrays, such
+ * as buffers and tables with integer keys, are sorted through a copy of
+ * their elements that is written back with put. */
+static void janet_sort_value(Janet ds, Janet keyfn, const JanetSortOrder *order, int stable) {
+    if (janet_checktype(ds, JANET_ARRAY)) {
+        janet_sort_array(janet_unwrap_array(ds), keyfn, order, stable);
+        return;
+    }
+    int32_t n = janet_length(ds);
+    JanetArray *copy = janet_array(n);
+    for (int32_t i = 0; i < n; i++) {
+        copy->data[i] = janet_in(ds, janet_wrap_integer(i));
+    }
+    copy->count = n;
+    janet_sort_array(copy, keyfn, order, stable);
+    for (int32_t i = 0; i < copy->count; i++) {
+        janet_put(ds, janet_wrap_integer(i), copy->data[i]);
+    }
+}
+
+JANET_CORE_FN(cfun_sort,
+              "(sort ind &opt before?)",
+              "Sort `ind` in-place, and return it. Uses introsort and is not a stable sort. "
+              "If a `before?` comparator function is provided, sorts elements using that, "
+              "otherwise uses `<`.") {
+    janet_arity(argc, 1, 2);
+    JanetSortOrder order = janet_getsortorder(argv, argc, 1);
+    janet_sort_value(argv[0], janet_wrap_nil(), &order, 0);
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_sort_stable,
+              "(sort-stable ind &opt before?)",
+              "Sort `ind` in-place, and return it. Like `sort`, but elements that are "
+              "neither before nor after each other keep their original order.") {
+    janet_arity(argc, 1, 2);
+    JanetSortOrder order = janet_getsortorder(argv, argc, 1);
+    janet_sort_value(argv[0], janet_wrap_nil(), &order, 1);
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_sort_by,
+              "(sort-by f ind)",
+              "Returns `ind` sorted by calling "
+              "a function `f` on each element and comparing the result with `<`. "
+              "`f` is called once per element, and the sort is stable.") {
+    janet_fixarity(argc, 2);
+    JanetSortOrder order = janet_getsortorder(argv, 0, 0);
+    janet_sort_value(argv[1], argv[0], &order, 1);
+    return argv[1];
+}
+
+JANET_CORE_FN(cfun_sorted,
+              "(sorted ind &opt before?)",
+              "Returns a new sorted array without modifying the old one. "
+              "If a `before?` comparator function is provided, sorts elements using that, "
+              "otherwise uses `<`.") {
+    janet_arity(argc, 1, 2);
+    JanetView view = janet_getindexed(argv, 0);
+    JanetArray *array = janet_array(view.len);
+    safe_memcpy(array->data, view.items, view.len * sizeof(Janet));
+    array->count = view.len;
+    JanetSortOrder order = janet_getsortorder(argv, argc, 1);
+    janet_sort_array(array, janet_wrap_nil(), &order, 0);
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_sorted_by,
+              "(sorted-by f ind)",
+              "Returns a new sorted array that compares elements by invoking "
+              "a function `f` on each element and comparing the result with `<`. "
+              "`f` is called once per element, and the sort is stable.") {
+    janet_fixarity(argc, 2);
+    JanetView view = janet_getindexed(argv, 1);
+    JanetArray *array = janet_array(view.len);
+    safe_memcpy(array->data, view.items, view.len * sizeof(Janet));
+    array->count = view.len;
+    JanetSortOrder order = janet_getsortorder(argv, 0, 0);
+    janet_sort_array(array, argv[0], &order, 1);
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_reverse,
+              "(reverse t)",
+              "Reverses the order of the elements in a given array or tuple and returns "
+              "a new array. If string or buffer is provided function returns array of chars reversed.") {
+    janet_fixarity(argc, 1);
+    const Janet *items;
+    const uint8_t *bytes;
+    int32_t len;
+    JanetArray *array;
+    if (janet_indexed_view(argv[0], &items, &len)) {
+        array = janet_array(len);
+        for (int32_t i = 0; i < len; i++) array->data[i] = items[len - 1 - i];
+    } else if (janet_bytes_view(argv[0], &bytes, &len)) {
+        array = janet_array(len);
+        for (int32_t i = 0; i < len; i++) array->data[i] = janet_wrap_integer(bytes[len - 1 - i]);
+    } else {
+        len = janet_length(argv[0]);
+        array = janet_array(len);
+        for (int32_t i = 0; i < len; i++) {
+            array->data[i] = janet_in(argv[0], janet_wrap_integer(len - 1 - i));
+        }
+    }
+    array->count = len;
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_partition,
+              "(partition n ind)",
+              "Partition an indexed data structure into tuples "
+              "of size n. Returns a new array.") {
+    janet_fixarity(argc, 2);
+    int32_t n = janet_getinteger(argv, 0);
+    if (n <= 0) janet_panicf("expected positive integer, got %v", argv[0]);
+    const Janet *items;
+    const uint8_t *bytes = NULL;
+    int32_t len;
+    if (!janet_indexed_view(argv[1], &items, &len) && !janet_bytes_view(argv[1], &bytes, &len)) {
+        janet_panic_type(argv[1], 1, JANET_TFLAG_INDEXED | JANET_TFLAG_BYTES);
+    }
+    JanetArray *array = janet_array(len / n + (len % n != 0));
+    for (int32_t i = 0; i < len; i += n) {
+        int32_t size = (len - i < n) ? len - i : n;
+        array->data[array->count++] = (NULL != bytes)
+                                      ? janet_wrap_string(janet_string(bytes + i, size))
+                                      : janet_wrap_tuple(janet_tuple_n(items + i, size));
+    }
+    return janet_wrap_array(array);
+}
+
+typedef struct {
+    JanetArray *into;
+    int depth;
+} JanetFlatten;
+
+static void janet_flatten_step(Janet x, void *data) {
+    JanetFlatten *state = (JanetFlatten *) data;
+    if (janet_checktypes(x, JANET_TFLAG_INDEXED)) {
+        if (state->depth >= JANET_RECURSION_GUARD) janet_panic("flatten recursed too deeply");
+        state->depth++;
+        janet_each(x, janet_flatten_step, state);
+        state->depth--;
+    } else {
+        janet_array_push(state->into, x);
+    }
+}
+
+JANET_CORE_FN(cfun_flatten_into,
+              "(flatten-into into xs)",
+              "Takes a nested array (tree), and appends the depth first traversal of "
+              "that array to an array 'into'. Returns array into.") {
+    janet_fixarity(argc, 2);
+    JanetFlatten state;
+    state.into = janet_getarray(argv, 0);
+    state.depth = 0;
+    janet_each(argv[1], janet_flatten_step, &state);
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_flatten,
+              "(flatten xs)",
+              "Takes a nested array (tree), and returns the depth first traversal of "
+              "that array. Returns a new array.") {
+    janet_fixarity(argc, 1);
+    JanetFlatten state;
+    state.into = janet_array(0);
+    state.depth = 0;
+    Janet root = janet_wrap_array(state.into);
+    janet_each_rooted(&root, 1, argv[0], janet_flatten_step, &state);
+    return root;
+}
+
+JANET_CORE_FN(cfun_interleave,
+              "(interleave & cols)",
+              "Returns an array of the first elements of each col, then the second, etc.") {
+    int32_t len = INT32_MAX;
+    for (int32_t i = 0; i < argc; i++) {
+        int32_t n = janet_length(argv[i]);
+        if (n < len) len = n;
+    }
+    if (argc == 0) return janet_wrap_array(janet_array(0));
+    if (len > INT32_MAX / argc) janet_panic("interleave result too large");
+    JanetArray *array = janet_array(len * argc);
+    for (int32_t i = 0; i < len; i++) {
+        for (int32_t j = 0; j < argc; j++) {
+            const Janet *items;
+            int32_t n;
+            array->data[array->count++] = janet_indexed_view(argv[j], &items, &n)
+                                          ? items[i]
+                                          : janet_in(argv[j], janet_wrap_integer(i));
+        }
+    }
+    return janet_wrap_array(array);
+}
+
+typedef struct {
+    JanetArray *array;
+    JanetTable *seen;
+} JanetDistinct;
+
+static void janet_distinct_step(Janet x, void *data) {
+    JanetDistinct *state = (JanetDistinct *) data;
+    if (janet_truthy(janet_table_rawget(state->seen, x))) return;
+    janet_table_put(state->seen, x, janet_wrap_true());
+    janet_array_push(state->array, x);
+}
+
+JANET_CORE_FN(cfun_distinct,
+              "(distinct xs)",
+              "Returns an array of the deduplicated values in xs.") {
+    janet_fixarity(argc, 1);
+    JanetDistinct state;
+    state.array = janet_array(0);
+    state.seen = janet_table(0);
+    Janet roots[2] = {janet_wrap_array(state.array), janet_wrap_table(state.seen)};
+    janet_each_rooted(roots, 2, argv[0], janet_distinct_step, &state);
+    return roots[0];
+}
+
 /* Load the array module */
 void janet_lib_array(JanetTable *env) {
     JanetRegExt array_cfuns[] = {
@@ -359,6 +799,17 @@ void janet_lib_array(JanetTable *env) {
         JANET_CORE_REG("array/remove", cfun_array_remove),
         JANET_CORE_REG("array/trim", cfun_array_trim),
         JANET_CORE_REG("array/clear", cfun_array_clear),
+        JANET_CORE_REG("sort", cfun_sort),
+        JANET_CORE_REG("sort-stable", cfun_sort_stable),
+        JANET_CORE_REG("sort-by", cfun_sort_by),
+        JANET_CORE_REG("sorted", cfun_sorted),
+        JANET_CORE_REG("sorted-by", cfun_sorted_by),
+        JANET_CORE_REG("reverse", cfun_reverse),
+        JANET_CORE_REG("partition", cfun_partition),
+        JANET_CORE_REG("flatten-into", cfun_flatten_into),
+        JANET_CORE_REG("flatten", cfun_flatten),
+        JANET_CORE_REG("interleave", cfun_interleave),
+        JANET_CORE_REG("distinct", cfun_distinct),
         JANET_REG_END
     };
     janet_core_cfuns_ext(env, NULL, array_cfuns);
@@ -90,6 +90,7 @@ static const JanetInstructionDef janet_ops[] = {
     {"jmpni", JOP_JUMP_IF_NIL},
     {"jmpnn", JOP_JUMP_IF_NOT_NIL},
     {"jmpno", JOP_JUMP_IF_NOT},
+    {"jmptab", JOP_JUMP_TABLE},
     {"ldc", JOP_LOAD_CONSTANT},
     {"ldf", JOP_LOAD_FALSE},
     {"ldi", JOP_LOAD_INTEGER},
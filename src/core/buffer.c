@@ -444,8 +444,8 @@ JANET_CORE_FN(cfun_buffer_format,
               " the modified buffer.") {
     janet_arity(argc, 2, -1);
     JanetBuffer *buffer = janet_getbuffer(argv, 0);
-    const char *strfrmt = (const char *) janet_getstring(argv, 1);
-    janet_buffer_format(buffer, strfrmt, 1, argc, argv);
+    Janet format = janet_getformat(argv, 1);
+    janet_buffer_format_value(buffer, format, 1, argc, argv);
     return argv[0];
 }
 
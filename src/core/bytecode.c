@@ -103,7 +103,8 @@ enum JanetInstructionType janet_instructions[JOP_INSTRUCTION_COUNT] = {
     JINT_SSS, /* JOP_NEXT */
     JINT_SSS, /* JOP_NOT_EQUALS, */
     JINT_SSI, /* JOP_NOT_EQUALS_IMMEDIATE, */
-    JINT_SSS /* JOP_CANCEL, */
+    JINT_SSS, /* JOP_CANCEL, */
+    JINT_SC /* JOP_JUMP_TABLE, */
 };
 
 /* Verify some bytecode */
@@ -174,6 +175,18 @@ int janet_verify(JanetFuncDef *def) {
             case JINT_SC: {
                 if ((int32_t)((instr >> 8) & 0xFF) >= sc) return 4;
                 if ((int32_t)(instr >> 16) >= def->constants_length) return 7;
+                if ((instr & 0x7F) == JOP_JUMP_TABLE) {
+                    /* Every entry in a jump table must be a valid jump */
+                    Janet table = def->constants[instr >> 16];
+                    if (!janet_checktype(table, JANET_STRUCT)) return 10;
+                    const JanetKV *st = janet_unwrap_struct(table);
+                    for (int32_t j = 0; j < janet_struct_capacity(st); j++) {
+                        if (janet_checktype(st[j].key, JANET_NIL)) continue;
+                        if (!janet_checkint(st[j].value)) return 10;
+                        int32_t jumpdest = i + janet_unwrap_integer(st[j].value);
+                        if (jumpdest < 0 || jumpdest >= def->bytecode_length) return 5;
+                    }
+                }
                 continue;
             }
             case JINT_SES: {
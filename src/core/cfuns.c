@@ -26,6 +26,7 @@
 #include "compile.h"
 #include "emit.h"
 #include "vector.h"
+#include "util.h"
 #endif
 
 static int arity1or2(JanetFopts opts, JanetSlot *args) {
@@ -399,3 +400,45 @@ const JanetFunOptimizer *janetc_funopt(uint32_t flags) {
     return optimizers + index;
 }
 
+
+/* C functions that take a format string, and the index of the format argument */
+Janet cfun_string_format(int32_t argc, Janet *argv);
+Janet cfun_buffer_format(int32_t argc, Janet *argv);
+Janet cfun_io_printf(int32_t argc, Janet *argv);
+Janet cfun_io_prinf(int32_t argc, Janet *argv);
+Janet cfun_io_eprintf(int32_t argc, Janet *argv);
+Janet cfun_io_eprinf(int32_t argc, Janet *argv);
+Janet cfun_io_xprintf(int32_t argc, Janet *argv);
+Janet cfun_io_xprinf(int32_t argc, Janet *argv);
+
+static const struct {
+    JanetCFunction cfun;
+    int32_t index;
+} format_cfuns[] = {
+    {cfun_string_format, 0},
+    {cfun_buffer_format, 1},
+    {cfun_io_printf, 0},
+    {cfun_io_prinf, 0},
+    {cfun_io_eprintf, 0},
+    {cfun_io_eprinf, 0},
+    {cfun_io_xprintf, 1},
+    {cfun_io_xprinf, 1}
+};
+
+void janetc_precompile_format(JanetSlot *slots, JanetCFunction cfun) {
+    int32_t index = -1;
+    for (size_t i = 0; i < sizeof(format_cfuns) / sizeof(format_cfuns[0]); i++) {
+        if (format_cfuns[i].cfun == cfun) {
+            index = format_cfuns[i].index;
+            break;
+        }
+    }
+    if (index < 0 || index >= janet_v_count(slots)) return;
+    for (int32_t i = 0; i <= index; i++) {
+        if (slots[i].flags & JANET_SLOT_SPLICED) return;
+    }
+    JanetSlot s = slots[index];
+    if (!(s.flags & JANET_SLOT_CONSTANT) || !janet_checktype(s.constant, JANET_STRING)) return;
+    Janet format = janet_format_compile(janet_unwrap_string(s.constant));
+    if (!janet_checktype(format, JANET_NIL)) slots[index] = janetc_cslot(format);
+}
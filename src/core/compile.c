@@ -460,6 +460,9 @@ static JanetSlot janetc_call(JanetFopts opts, JanetSlot *slots, JanetSlot fun) {
     JanetSlot retslot;
     JanetCompiler *c = opts.compiler;
     int specialized = 0;
+    if ((fun.flags & JANET_SLOT_CONSTANT) && janet_checktype(fun.constant, JANET_CFUNCTION)) {
+        janetc_precompile_format(slots, janet_unwrap_cfunction(fun.constant));
+    }
     if (fun.flags & JANET_SLOT_CONSTANT && !has_spliced(slots)) {
         if (janet_checktype(fun.constant, JANET_FUNCTION)) {
             JanetFunction *f = janet_unwrap_function(fun.constant);
@@ -621,6 +624,73 @@ static JanetSlot janetc_bufferctor(JanetFopts opts, Janet x) {
                         JOP_MAKE_BUFFER);
 }
 
+/* Check if a value is made only of immutable values, so its hash and
+ * equality are structural. Only such forms are keys in the macro cache.
+ * Equality ignores tuple flags, so each tuple also writes its bracket
+ * type to shape, and the shape becomes part of the key. */
+static int macro_cacheable(Janet x, int depth, JanetBuffer *shape) {
+    if (depth > JANET_RECURSION_GUARD) return 0;
+    switch (janet_type(x)) {
+        default:
+            return 0;
+        case JANET_NIL:
+        case JANET_BOOLEAN:
+        case JANET_NUMBER:
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD:
+            return 1;
+        case JANET_TUPLE: {
+            const Janet *t = janet_unwrap_tuple(x);
+            janet_buffer_push_u8(shape,
+                                 (janet_tuple_flag(t) & JANET_TUPLE_FLAG_BRACKETCTOR) ? '[' : '(');
+            for (int32_t i = 0; i < janet_tuple_length(t); i++) {
+                if (!macro_cacheable(t[i], depth + 1, shape)) return 0;
+            }
+            janet_buffer_push_u8(shape, ')');
+            return 1;
+        }
+        case JANET_STRUCT: {
+            const JanetKV *st = janet_unwrap_struct(x);
+            for (int32_t i = 0; i < janet_struct_capacity(st); i++) {
+                if (janet_checktype(st[i].key, JANET_NIL)) continue;
+                if (!macro_cacheable(st[i].key, depth + 1, shape)) return 0;
+                if (!macro_cacheable(st[i].value, depth + 1, shape)) return 0;
+            }
+            return 1;
+        }
+    }
+}
+
+/* Get the key for a macro expansion in the macro cache, or nil if the
+ * expansion should not be cached. Only macros with :pure metadata are
+ * cached, and only when (dyn :macro-cache) is a table. */
+static Janet macro_cachekey(JanetCompiler *c, Janet macroval, Janet x, JanetTable **cache) {
+    const Janet *form = janet_unwrap_tuple(x);
+    Janet entry = janet_table_get(c->env, form[0]);
+    if (!janet_checktype(entry, JANET_TABLE)) return janet_wrap_nil();
+    if (!janet_truthy(janet_table_get(janet_unwrap_table(entry), janet_ckeywordv("pure"))))
+        return janet_wrap_nil();
+    Janet cachev = janet_dyn("macro-cache");
+    if (!janet_checktype(cachev, JANET_TABLE)) return janet_wrap_nil();
+    JanetBuffer shape;
+    janet_buffer_init(&shape, 16);
+    if (!macro_cacheable(x, 0, &shape)) {
+        janet_buffer_deinit(&shape);
+        return janet_wrap_nil();
+    }
+    *cache = janet_unwrap_table(cachev);
+    /* Include the source position so cached expansions keep correct source maps */
+    Janet *key = janet_tuple_begin(5);
+    key[0] = macroval;
+    key[1] = x;
+    key[2] = janet_stringv(shape.data, shape.count);
+    key[3] = janet_wrap_integer(janet_tuple_sm_line(form));
+    key[4] = janet_wrap_integer(janet_tuple_sm_column(form));
+    janet_buffer_deinit(&shape);
+    return janet_wrap_tuple(janet_tuple_end(key));
+}
+
 /* Expand a macro one time. Also get the special form compiler if we
  * find that instead. */
 static int macroexpand1(
@@ -655,6 +725,17 @@ static int macroexpand1(
             !janet_checktype(macroval, JANET_FUNCTION))
         return 0;
 
+    /* Reuse an earlier expansion of a pure macro */
+    JanetTable *cache = NULL;
+    Janet cachekey = macro_cachekey(c, macroval, x, &cache);
+    if (cache) {
+        Janet cached = janet_table_get(cache, cachekey);
+        if (!janet_checktype(cached, JANET_NIL)) {
+            *out = cached;
+            return 1;
+        }
+    }
+
     /* Evaluate macro */
     JanetFunction *macro = janet_unwrap_function(macroval);
     int32_t arity = janet_tuple_length(form) - 1;
@@ -690,6 +771,9 @@ static int macroexpand1(
         return 0;
     } else {
         *out = tempOut;
+        if (cache && !janet_checktype(tempOut, JANET_NIL)) {
+            janet_table_put(cache, cachekey, tempOut);
+        }
     }
 
     return 1;
@@ -925,6 +1009,7 @@ JanetCompileResult janet_compile_lint(Janet source,
     if (c.result.status == JANET_COMPILE_OK) {
         JanetFuncDef *def = janetc_pop_funcdef(&c);
         def->name = janet_cstring("_thunk");
+        janetc_regalloc_liveness(def);
         janet_def_addflags(def);
         c.result.funcdef = def;
     } else {
@@ -949,7 +1034,9 @@ JANET_CORE_FN(cfun,
               "eval. Returns a new function and does not modify ast. Returns an error "
               "struct with keys :line, :column, and :error if compilation fails. "
               "If a `lints` array is given, linting messages will be appended to the array. "
-              "Each message will be a tuple of the form `(level line col message)`.") {
+              "Each message will be a tuple of the form `(level line col message)`. "
+              "If `(dyn :macro-cache)` is a table, expansions of macros marked `:pure` "
+              "are memoized in it and reused when the same form is compiled again.") {
     janet_arity(argc, 1, 4);
     JanetTable *env = argc > 1 ? janet_gettable(argv, 1) : janet_vm.fiber->env;
     if (NULL == env) {
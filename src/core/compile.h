@@ -207,6 +207,9 @@ struct JanetSpecial {
 /* Get an optimizer if it exists, otherwise NULL */
 const JanetFunOptimizer *janetc_funopt(uint32_t flags);
 
+/* Parse constant format strings passed to C functions like string/format */
+void janetc_precompile_format(JanetSlot *slots, JanetCFunction cfun);
+
 /* Get a special. Return NULL if none exists */
 const JanetSpecial *janetc_special(const uint8_t *name);
 
@@ -284,6 +284,26 @@ JANET_CORE_FN(janet_core_expand_path,
     return janet_wrap_buffer(out);
 }
 
+JANET_CORE_FN(janet_core_module_hash,
+              "(module/hash bytes)",
+              "Get a 64 bit FNV-1a hash of a byte sequence as a string of 16 hex digits. "
+              "Unlike `hash`, the result does not depend on the per process hash seed, so it "
+              "is suitable for persistent keys such as those used by the module cache.") {
+    janet_fixarity(argc, 1);
+    JanetByteView bytes = janet_getbytes(argv, 0);
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (int32_t i = 0; i < bytes.len; i++) {
+        hash ^= bytes.bytes[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    uint8_t digits[16];
+    for (int i = 15; i >= 0; i--) {
+        digits[i] = "0123456789abcdef"[hash & 0xF];
+        hash >>= 4;
+    }
+    return janet_stringv(digits, 16);
+}
+
 JANET_CORE_FN(janet_core_dyn,
               "(dyn key &opt default)",
               "Get a dynamic binding. Returns the default value (or nil) if no binding found.") {
@@ -428,11 +448,14 @@ JANET_CORE_FN(janet_core_array,
 
 JANET_CORE_FN(janet_core_slice,
               "(slice x &opt start end)",
-              "Extract a sub-range of an indexed data structure or byte sequence.") {
+              "Extract a sub-range of an indexed data structure or byte sequence. "
+              "Slicing a lazy range returns another lazy range.") {
     JanetRange range;
     JanetByteView bview;
     JanetView iview;
-    if (janet_bytes_view(argv[0], &bview.bytes, &bview.len)) {
+    if (janet_checkabstract(argv[0], &janet_range_type)) {
+        return janet_range_slice(argc, argv);
+    } else if (janet_bytes_view(argv[0], &bview.bytes, &bview.len)) {
         range = janet_getslice(argc, argv);
         return janet_stringv(bview.bytes + range.start, range.end - range.start);
     } else if (janet_indexed_view(argv[0], &iview.items, &iview.len)) {
@@ -556,6 +579,111 @@ JANET_CORE_FN(janet_core_hash,
     return janet_wrap_number(janet_hash(argv[0]));
 }
 
+/* Structural equality. Dictionaries are compared with
+ * janet_deep_equals_dict, independent of entry order. */
+static int janet_deep_equals(Janet x, Janet y, int depth);
+
+static Janet deep_rawget(Janet ds, Janet key) {
+    return janet_checktype(ds, JANET_TABLE)
+           ? janet_table_rawget(janet_unwrap_table(ds), key)
+           : janet_struct_get(janet_unwrap_struct(ds), key);
+}
+
+/* Values of keys found in both dictionaries are compared by key. Keys
+ * without an equal key in the other dictionary may still be equal only
+ * structurally, such as two arrays, so those are paired up by search. */
+static int janet_deep_equals_dict(Janet x, Janet y, int depth) {
+    const JanetKV *xs, *ys;
+    int32_t xlen, xcap, ylen, ycap;
+    janet_dictionary_view(x, &xs, &xlen, &xcap);
+    janet_dictionary_view(y, &ys, &ylen, &ycap);
+    if (xlen != ylen) return 0;
+    int32_t unmatched = 0;
+    for (int32_t i = 0; i < xcap; i++) {
+        if (janet_checktype(xs[i].key, JANET_NIL)) continue;
+        Janet other = deep_rawget(y, xs[i].key);
+        if (janet_checktype(other, JANET_NIL)) {
+            unmatched++;
+        } else if (!janet_deep_equals(xs[i].value, other, depth + 1)) {
+            return 0;
+        }
+    }
+    if (!unmatched) return 1;
+    /* Scratch memory is reclaimed if a comparison panics */
+    char *taken = janet_scalloc((size_t) ycap, 1);
+    for (int32_t j = 0; j < ycap; j++) {
+        if (janet_checktype(ys[j].key, JANET_NIL) ||
+                !janet_checktype(deep_rawget(x, ys[j].key), JANET_NIL)) {
+            taken[j] = 1;
+        }
+    }
+    for (int32_t i = 0; i < xcap; i++) {
+        if (janet_checktype(xs[i].key, JANET_NIL)) continue;
+        if (!janet_checktype(deep_rawget(y, xs[i].key), JANET_NIL)) continue;
+        int32_t j;
+        for (j = 0; j < ycap; j++) {
+            if (!taken[j] &&
+                    janet_deep_equals(xs[i].key, ys[j].key, depth + 1) &&
+                    janet_deep_equals(xs[i].value, ys[j].value, depth + 1)) {
+                break;
+            }
+        }
+        if (j == ycap) {
+            janet_sfree(taken);
+            return 0;
+        }
+        taken[j] = 1;
+    }
+    janet_sfree(taken);
+    return 1;
+}
+
+static int janet_deep_equals(Janet x, Janet y, int depth) {
+    JanetType t = janet_type(x);
+    if (t != janet_type(y)) return 0;
+    if (depth >= JANET_RECURSION_GUARD) janet_panic("deep= recursed too deeply");
+    switch (t) {
+        default:
+            return janet_equals(x, y);
+        case JANET_ARRAY:
+        case JANET_TUPLE: {
+            const Janet *xs, *ys;
+            int32_t xlen, ylen;
+            janet_indexed_view(x, &xs, &xlen);
+            janet_indexed_view(y, &ys, &ylen);
+            if (xlen != ylen) return 0;
+            for (int32_t i = 0; i < xlen; i++) {
+                if (!janet_deep_equals(xs[i], ys[i], depth + 1)) return 0;
+            }
+            return 1;
+        }
+        case JANET_BUFFER: {
+            JanetBuffer *bx = janet_unwrap_buffer(x);
+            JanetBuffer *by = janet_unwrap_buffer(y);
+            return bx->count == by->count && !memcmp(bx->data, by->data, bx->count);
+        }
+        case JANET_STRUCT:
+        case JANET_TABLE:
+            return janet_deep_equals_dict(x, y, depth);
+    }
+}
+
+JANET_CORE_FN(janet_core_deep_equals,
+              "(deep= x y)",
+              "Like =, but mutable types (arrays, tables, buffers) are considered "
+              "equal if they have identical structure. Much slower than =.") {
+    janet_fixarity(argc, 2);
+    return janet_wrap_boolean(janet_deep_equals(argv[0], argv[1], 0));
+}
+
+JANET_CORE_FN(janet_core_deep_not_equals,
+              "(deep-not= x y)",
+              "Like not=, but mutable types (arrays, tables, buffers) are considered "
+              "equal if they have identical structure. Much slower than not=.") {
+    janet_fixarity(argc, 2);
+    return janet_wrap_boolean(!janet_deep_equals(argv[0], argv[1], 0));
+}
+
 JANET_CORE_FN(janet_core_getline,
               "(getline &opt prompt buf env)",
               "Reads a line of input into a buffer, including the newline character, using a prompt. "
@@ -944,12 +1072,15 @@ static void janet_load_libs(JanetTable *env) {
         JANET_CORE_REG("gcinterval", janet_core_gcinterval),
         JANET_CORE_REG("type", janet_core_type),
         JANET_CORE_REG("hash", janet_core_hash),
+        JANET_CORE_REG("deep=", janet_core_deep_equals),
+        JANET_CORE_REG("deep-not=", janet_core_deep_not_equals),
         JANET_CORE_REG("getline", janet_core_getline),
         JANET_CORE_REG("dyn", janet_core_dyn),
         JANET_CORE_REG("setdyn", janet_core_setdyn),
         JANET_CORE_REG("trace", janet_core_trace),
         JANET_CORE_REG("untrace", janet_core_untrace),
         JANET_CORE_REG("module/expand-path", janet_core_expand_path),
+        JANET_CORE_REG("module/hash", janet_core_module_hash),
         JANET_CORE_REG("int?", janet_core_check_int),
         JANET_CORE_REG("nat?", janet_core_check_nat),
         JANET_CORE_REG("slice", janet_core_slice),
@@ -970,6 +1101,14 @@ static void janet_load_libs(JanetTable *env) {
     janet_lib_debug(env);
     janet_lib_string(env);
     janet_lib_marsh(env);
+    janet_lib_persistent(env);
+    janet_lib_rope(env);
+    janet_lib_deque(env);
+    janet_lib_heap(env);
+    janet_lib_set(env);
+    janet_lib_iter(env);
+    janet_lib_range(env);
+    janet_lib_record(env);
 #ifdef JANET_PEG
     janet_lib_peg(env);
 #endif
@@ -979,6 +1118,9 @@ static void janet_load_libs(JanetTable *env) {
 #ifdef JANET_INT_TYPES
     janet_lib_inttypes(env);
 #endif
+#ifdef JANET_TYPED_ARRAY
+    janet_lib_typed_array(env);
+#endif
 #ifdef JANET_THREADS
     janet_lib_thread(env);
 #endif
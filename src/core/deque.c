@@ -0,0 +1,237 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+/*
+ * Double ended queues. A deque is a growable ring buffer of values (the
+ * same ring buffer the event loop uses for its queues), so pushing and
+ * popping at either end take constant time.
+ */
+
+static Janet deque_ref(JanetQueue *q, int32_t i) {
+    return *(Janet *) janet_q_at(q, i, sizeof(Janet));
+}
+
+static int deque_gc(void *p, size_t size) {
+    (void) size;
+    janet_q_deinit((JanetQueue *) p);
+    return 0;
+}
+
+static int deque_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetQueue *q = (JanetQueue *) p;
+    int32_t count = janet_q_count(q);
+    for (int32_t i = 0; i < count; i++) {
+        janet_mark(deque_ref(q, i));
+    }
+    return 0;
+}
+
+static int deque_get(void *p, Janet key, Janet *out) {
+    JanetQueue *q = (JanetQueue *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= janet_q_count(q)) return 0;
+    *out = deque_ref(q, i);
+    return 1;
+}
+
+static void deque_put(void *p, Janet key, Janet value) {
+    JanetQueue *q = (JanetQueue *) p;
+    int32_t count = janet_q_count(q);
+    if (!janet_checkint(key)) janet_panicf("expected integer key, got %v", key);
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= count) janet_panicf("index %d out of range [0,%d)", i, count);
+    *(Janet *) janet_q_at(q, i, sizeof(Janet)) = value;
+}
+
+static Janet deque_next(void *p, Janet key) {
+    JanetQueue *q = (JanetQueue *) p;
+    int32_t count = janet_q_count(q);
+    if (janet_checktype(key, JANET_NIL)) {
+        return count ? janet_wrap_integer(0) : janet_wrap_nil();
+    }
+    if (!janet_checkint(key)) return janet_wrap_nil();
+    int32_t i = janet_unwrap_integer(key);
+    return (i >= 0 && i + 1 < count) ? janet_wrap_integer(i + 1) : janet_wrap_nil();
+}
+
+static int32_t deque_length(void *p, size_t size) {
+    (void) size;
+    return janet_q_count((JanetQueue *) p);
+}
+
+static void deque_tostring(void *p, JanetBuffer *buffer) {
+    JanetQueue *q = (JanetQueue *) p;
+    int32_t count = janet_q_count(q);
+    janet_buffer_push_u8(buffer, '[');
+    for (int32_t i = 0; i < count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, deque_ref(q, i));
+    }
+    janet_buffer_push_u8(buffer, ']');
+}
+
+static void deque_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetQueue *q = (JanetQueue *) p;
+    int32_t count = janet_q_count(q);
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, count);
+    for (int32_t i = 0; i < count; i++) {
+        janet_marshal_janet(ctx, deque_ref(q, i));
+    }
+}
+
+static void deque_push(JanetQueue *q, Janet x) {
+    if (janet_q_push(q, &x, sizeof(Janet))) janet_panic("deque overflow");
+}
+
+static void *deque_unmarshal(JanetMarshalContext *ctx) {
+    JanetQueue *q = janet_unmarshal_abstract(ctx, sizeof(JanetQueue));
+    janet_q_init(q);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid deque length");
+    for (int32_t i = 0; i < count; i++) {
+        deque_push(q, janet_unmarshal_janet(ctx));
+    }
+    return q;
+}
+
+static const JanetAbstractType janet_deque_type = {
+    "core/deque",
+    deque_gc,
+    deque_gcmark,
+    deque_get,
+    deque_put,
+    deque_marshal,
+    deque_unmarshal,
+    deque_tostring,
+    NULL,
+    NULL,
+    deque_next,
+    NULL,
+    deque_length,
+    JANET_ATEND_LENGTH
+};
+
+JANET_CORE_FN(cfun_deque_new,
+              "(deque/new & xs)",
+              "Create a double ended queue holding xs. Values can be pushed and popped at "
+              "either end in constant time, and a deque can be indexed and iterated like an array.") {
+    JanetQueue *q = janet_abstract(&janet_deque_type, sizeof(JanetQueue));
+    janet_q_init(q);
+    for (int32_t i = 0; i < argc; i++) {
+        deque_push(q, argv[i]);
+    }
+    return janet_wrap_abstract(q);
+}
+
+JANET_CORE_FN(cfun_deque_push,
+              "(deque/push dq & xs)",
+              "Push each of xs onto the back of a deque. Returns the deque.") {
+    janet_arity(argc, 1, -1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    for (int32_t i = 1; i < argc; i++) {
+        deque_push(q, argv[i]);
+    }
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_deque_push_front,
+              "(deque/push-front dq & xs)",
+              "Push each of xs onto the front of a deque in turn, so the last of xs ends up "
+              "first. Returns the deque.") {
+    janet_arity(argc, 1, -1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    for (int32_t i = 1; i < argc; i++) {
+        if (janet_q_push_head(q, argv + i, sizeof(Janet))) janet_panic("deque overflow");
+    }
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_deque_pop,
+              "(deque/pop dq)",
+              "Remove and return the last value of a deque, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    Janet x;
+    return janet_q_pop_tail(q, &x, sizeof(Janet)) ? janet_wrap_nil() : x;
+}
+
+JANET_CORE_FN(cfun_deque_pop_front,
+              "(deque/pop-front dq)",
+              "Remove and return the first value of a deque, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    Janet x;
+    return janet_q_pop(q, &x, sizeof(Janet)) ? janet_wrap_nil() : x;
+}
+
+JANET_CORE_FN(cfun_deque_peek,
+              "(deque/peek dq)",
+              "Get the last value of a deque without removing it, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    int32_t count = janet_q_count(q);
+    return count ? deque_ref(q, count - 1) : janet_wrap_nil();
+}
+
+JANET_CORE_FN(cfun_deque_peek_front,
+              "(deque/peek-front dq)",
+              "Get the first value of a deque without removing it, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    return janet_q_count(q) ? deque_ref(q, 0) : janet_wrap_nil();
+}
+
+JANET_CORE_FN(cfun_deque_clear,
+              "(deque/clear dq)",
+              "Remove every value from a deque, keeping its capacity. Returns the deque.") {
+    janet_fixarity(argc, 1);
+    JanetQueue *q = janet_getabstract(argv, 0, &janet_deque_type);
+    q->head = q->tail = 0;
+    return argv[0];
+}
+
+/* Module entry point */
+void janet_lib_deque(JanetTable *env) {
+    JanetRegExt deque_cfuns[] = {
+        JANET_CORE_REG("deque/new", cfun_deque_new),
+        JANET_CORE_REG("deque/push", cfun_deque_push),
+        JANET_CORE_REG("deque/push-front", cfun_deque_push_front),
+        JANET_CORE_REG("deque/pop", cfun_deque_pop),
+        JANET_CORE_REG("deque/pop-front", cfun_deque_pop_front),
+        JANET_CORE_REG("deque/peek", cfun_deque_peek),
+        JANET_CORE_REG("deque/peek-front", cfun_deque_peek_front),
+        JANET_CORE_REG("deque/clear", cfun_deque_clear),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, deque_cfuns);
+    janet_register_abstract_type(&janet_deque_type);
+}
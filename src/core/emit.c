@@ -49,7 +49,7 @@ void janetc_emit(JanetCompiler *c, uint32_t instr) {
 }
 
 /* Add a constant to the current scope. Return the index of the constant. */
-static int32_t janetc_const(JanetCompiler *c, Janet x) {
+int32_t janetc_const(JanetCompiler *c, Janet x) {
     JanetScope *scope = c->scope;
     int32_t i, len;
     /* Get the topmost function scope */
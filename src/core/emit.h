@@ -32,6 +32,9 @@ void janetc_emit(JanetCompiler *c, uint32_t instr);
 int32_t janetc_allocfar(JanetCompiler *c);
 int32_t janetc_allocnear(JanetCompiler *c, JanetcRegisterTemp);
 
+/* Add a constant to the current function. Returns the constant index. */
+int32_t janetc_const(JanetCompiler *c, Janet x);
+
 int32_t janetc_emit_s(JanetCompiler *c, uint8_t op, JanetSlot s, int wr);
 int32_t janetc_emit_sl(JanetCompiler *c, uint8_t op, JanetSlot s, int32_t label);
 int32_t janetc_emit_st(JanetCompiler *c, uint8_t op, JanetSlot s, int32_t tflags);
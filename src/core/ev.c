@@ -90,61 +90,6 @@ typedef struct {
     JanetHandle write_pipe;
 } JanetEVThreadInit;
 
-#define JANET_MAX_Q_CAPACITY 0x7FFFFFF
-
-static void janet_q_init(JanetQueue *q) {
-    q->data = NULL;
-    q->head = 0;
-    q->tail = 0;
-    q->capacity = 0;
-}
-
-static void janet_q_deinit(JanetQueue *q) {
-    janet_free(q->data);
-}
-
-static int32_t janet_q_count(JanetQueue *q) {
-    return (q->head > q->tail)
-           ? (q->tail + q->capacity - q->head)
-           : (q->tail - q->head);
-}
-
-static int janet_q_push(JanetQueue *q, void *item, size_t itemsize) {
-    int32_t count = janet_q_count(q);
-    /* Resize if needed */
-    if (count + 1 >= q->capacity) {
-        if (count + 1 >= JANET_MAX_Q_CAPACITY) return 1;
-        int32_t newcap = (count + 2) * 2;
-        if (newcap > JANET_MAX_Q_CAPACITY) newcap = JANET_MAX_Q_CAPACITY;
-        q->data = janet_realloc(q->data, itemsize * newcap);
-        if (NULL == q->data) {
-            JANET_OUT_OF_MEMORY;
-        }
-        if (q->head > q->tail) {
-            /* Two segments, fix 2nd seg. */
-            int32_t newhead = q->head + (newcap - q->capacity);
-            size_t seg1 = (size_t)(q->capacity - q->head);
-            if (seg1 > 0) {
-                memmove((char *) q->data + (newhead * itemsize),
-                        (char *) q->data + (q->head * itemsize),
-                        seg1 * itemsize);
-            }
-            q->head = newhead;
-        }
-        q->capacity = newcap;
-    }
-    memcpy((char *) q->data + itemsize * q->tail, item, itemsize);
-    q->tail = q->tail + 1 < q->capacity ? q->tail + 1 : 0;
-    return 0;
-}
-
-static int janet_q_pop(JanetQueue *q, void *out, size_t itemsize) {
-    if (q->head == q->tail) return 1;
-    memcpy(out, (char *) q->data + itemsize * q->head, itemsize);
-    q->head = q->head + 1 < q->capacity ? q->head + 1 : 0;
-    return 0;
-}
-
 /* Forward declaration */
 static void janet_unlisten(JanetListenerState *state, int is_gc);
 
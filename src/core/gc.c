@@ -152,7 +152,7 @@ recur: /* Manual tail recursion */
     if (janet_gc_reachable(table))
         return;
     janet_gc_mark(table);
-    janet_mark_kvs(table->data, table->capacity);
+    janet_mark_kvs(table->data, table->count + table->deleted);
     if (table->proto) {
         table = table->proto;
         goto recur;
@@ -0,0 +1,327 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+/*
+ * Binary heaps. The first item is always one that no other item is before.
+ * Each item gets a small integer handle when it is pushed, which stays valid
+ * while the item is in the heap and can be used to change its value later.
+ * Handles of removed items are reused.
+ */
+
+typedef struct {
+    Janet value;
+    int32_t handle;
+} JanetHeapItem;
+
+typedef struct {
+    JanetSortOrder order;
+    JanetHeapItem *items;
+    int32_t count;
+    int32_t capacity;
+    /* Position of each handle's item, or -1 for unused handles */
+    int32_t *positions;
+    int32_t handle_count;
+    /* Stack of unused handles */
+    int32_t *free_handles;
+    int32_t free_count;
+} JanetHeap;
+
+static void heap_init(JanetHeap *h, JanetSortOrder order) {
+    h->order = order;
+    h->items = NULL;
+    h->count = 0;
+    h->capacity = 0;
+    h->positions = NULL;
+    h->handle_count = 0;
+    h->free_handles = NULL;
+    h->free_count = 0;
+}
+
+static void heap_ensure(JanetHeap *h, int32_t capacity) {
+    if (capacity <= h->capacity) return;
+    if (capacity > INT32_MAX / 2) janet_panic("heap overflow");
+    int32_t newcap = capacity < 4 ? 4 : capacity;
+    if (newcap < 2 * h->capacity) newcap = 2 * h->capacity;
+    JanetHeapItem *items = janet_realloc(h->items, newcap * sizeof(JanetHeapItem));
+    int32_t *positions = janet_realloc(h->positions, newcap * sizeof(int32_t));
+    int32_t *free_handles = janet_realloc(h->free_handles, newcap * sizeof(int32_t));
+    if (NULL == items || NULL == positions || NULL == free_handles) {
+        JANET_OUT_OF_MEMORY;
+    }
+    h->items = items;
+    h->positions = positions;
+    h->free_handles = free_handles;
+    h->capacity = newcap;
+}
+
+/* Compare the items at two positions. A comparator can run arbitrary code,
+ * so make sure it did not change the heap out from under us. */
+static int heap_before(JanetHeap *h, int32_t i, int32_t j) {
+    int32_t count = h->count;
+    int before = janet_sort_before(&h->order, h->items[i].value, h->items[j].value);
+    if (h->count != count) janet_panic("heap changed during comparison");
+    return before;
+}
+
+static void heap_swap(JanetHeap *h, int32_t i, int32_t j) {
+    JanetHeapItem tmp = h->items[i];
+    h->items[i] = h->items[j];
+    h->items[j] = tmp;
+    h->positions[h->items[i].handle] = i;
+    h->positions[h->items[j].handle] = j;
+}
+
+static int32_t heap_sift_up(JanetHeap *h, int32_t i) {
+    while (i > 0) {
+        int32_t parent = (i - 1) / 2;
+        if (!heap_before(h, i, parent)) break;
+        heap_swap(h, i, parent);
+        i = parent;
+    }
+    return i;
+}
+
+static void heap_sift_down(JanetHeap *h, int32_t i) {
+    for (;;) {
+        int32_t least = i;
+        int32_t left = 2 * i + 1;
+        int32_t right = left + 1;
+        if (left < h->count && heap_before(h, left, least)) least = left;
+        if (right < h->count && heap_before(h, right, least)) least = right;
+        if (least == i) break;
+        heap_swap(h, i, least);
+        i = least;
+    }
+}
+
+static int32_t heap_push(JanetHeap *h, Janet x) {
+    if (h->count == INT32_MAX) janet_panic("heap overflow");
+    heap_ensure(h, h->count + 1);
+    int32_t handle = h->free_count ? h->free_handles[--h->free_count] : h->handle_count++;
+    int32_t i = h->count++;
+    h->items[i].value = x;
+    h->items[i].handle = handle;
+    h->positions[handle] = i;
+    heap_sift_up(h, i);
+    return handle;
+}
+
+static Janet heap_pop(JanetHeap *h) {
+    if (h->count == 0) return janet_wrap_nil();
+    JanetHeapItem top = h->items[0];
+    h->positions[top.handle] = -1;
+    h->free_handles[h->free_count++] = top.handle;
+    if (--h->count) {
+        h->items[0] = h->items[h->count];
+        h->positions[h->items[0].handle] = 0;
+        heap_sift_down(h, 0);
+    }
+    return top.value;
+}
+
+static int heap_gc(void *p, size_t size) {
+    (void) size;
+    JanetHeap *h = (JanetHeap *) p;
+    janet_free(h->items);
+    janet_free(h->positions);
+    janet_free(h->free_handles);
+    return 0;
+}
+
+static int heap_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetHeap *h = (JanetHeap *) p;
+    janet_mark(h->order.before);
+    for (int32_t i = 0; i < h->count; i++) {
+        janet_mark(h->items[i].value);
+    }
+    return 0;
+}
+
+static int32_t heap_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetHeap *) p)->count;
+}
+
+static void heap_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetHeap *h = (JanetHeap *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, h->order.kind);
+    janet_marshal_janet(ctx, h->order.before);
+    janet_marshal_int(ctx, h->handle_count);
+    janet_marshal_int(ctx, h->count);
+    for (int32_t i = 0; i < h->count; i++) {
+        janet_marshal_int(ctx, h->items[i].handle);
+        janet_marshal_janet(ctx, h->items[i].value);
+    }
+}
+
+/* Items are stored in heap order, so they can be read back in place */
+static void *heap_unmarshal(JanetMarshalContext *ctx) {
+    JanetHeap *h = janet_unmarshal_abstract(ctx, sizeof(JanetHeap));
+    JanetSortOrder order;
+    order.before = janet_wrap_nil();
+    order.kind = JANET_SORT_LT;
+    heap_init(h, order);
+    int32_t kind = janet_unmarshal_int(ctx);
+    if (kind < JANET_SORT_LT || kind > JANET_SORT_CALL) janet_panic("invalid heap");
+    h->order.kind = (JanetSortKind) kind;
+    h->order.before = janet_unmarshal_janet(ctx);
+    int32_t handle_count = janet_unmarshal_int(ctx);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0 || handle_count < count) janet_panic("invalid heap");
+    heap_ensure(h, handle_count);
+    for (int32_t i = 0; i < handle_count; i++) h->positions[i] = -1;
+    h->handle_count = handle_count;
+    for (int32_t i = 0; i < count; i++) {
+        int32_t handle = janet_unmarshal_int(ctx);
+        if (handle < 0 || handle >= handle_count || h->positions[handle] != -1) {
+            janet_panic("invalid heap");
+        }
+        h->positions[handle] = i;
+        h->items[i].handle = handle;
+        h->items[i].value = janet_unmarshal_janet(ctx);
+        h->count++;
+    }
+    for (int32_t i = handle_count - 1; i >= 0; i--) {
+        if (h->positions[i] == -1) h->free_handles[h->free_count++] = i;
+    }
+    return h;
+}
+
+static const JanetAbstractType janet_heap_type = {
+    "core/heap",
+    heap_gc,
+    heap_gcmark,
+    NULL,
+    NULL,
+    heap_marshal,
+    heap_unmarshal,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    heap_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetHeap *heap_new(const Janet *argv, int32_t argc, int32_t n) {
+    JanetSortOrder order = janet_getsortorder(argv, argc, n);
+    JanetHeap *h = janet_abstract(&janet_heap_type, sizeof(JanetHeap));
+    heap_init(h, order);
+    return h;
+}
+
+JANET_CORE_FN(cfun_heap_new,
+              "(heap/new &opt before?)",
+              "Create an empty binary heap, also known as a priority queue. Items come out "
+              "smallest first, or first by the `before?` comparator if one is given. Passing `>` "
+              "makes a max heap.") {
+    janet_arity(argc, 0, 1);
+    return janet_wrap_abstract(heap_new(argv, argc, 0));
+}
+
+JANET_CORE_FN(cfun_heap_from,
+              "(heap/from xs &opt before?)",
+              "Create a binary heap holding the values in xs, in linear time. The item from "
+              "index i of xs gets the handle i. See heap/new.") {
+    janet_arity(argc, 1, 2);
+    JanetView view = janet_getindexed(argv, 0);
+    JanetHeap *h = heap_new(argv, argc, 1);
+    heap_ensure(h, view.len);
+    for (int32_t i = 0; i < view.len; i++) {
+        h->items[i].value = view.items[i];
+        h->items[i].handle = i;
+        h->positions[i] = i;
+    }
+    h->count = view.len;
+    h->handle_count = view.len;
+    for (int32_t i = view.len / 2 - 1; i >= 0; i--) {
+        heap_sift_down(h, i);
+    }
+    return janet_wrap_abstract(h);
+}
+
+JANET_CORE_FN(cfun_heap_push,
+              "(heap/push heap x)",
+              "Add x to a heap. Returns a handle for the new item that can be passed to "
+              "heap/update while the item is in the heap.") {
+    janet_fixarity(argc, 2);
+    JanetHeap *h = janet_getabstract(argv, 0, &janet_heap_type);
+    return janet_wrap_integer(heap_push(h, argv[1]));
+}
+
+JANET_CORE_FN(cfun_heap_pop,
+              "(heap/pop heap)",
+              "Remove and return the first item of a heap, or nil if the heap is empty.") {
+    janet_fixarity(argc, 1);
+    JanetHeap *h = janet_getabstract(argv, 0, &janet_heap_type);
+    return heap_pop(h);
+}
+
+JANET_CORE_FN(cfun_heap_peek,
+              "(heap/peek heap)",
+              "Get the first item of a heap without removing it, or nil if the heap is empty.") {
+    janet_fixarity(argc, 1);
+    JanetHeap *h = janet_getabstract(argv, 0, &janet_heap_type);
+    return h->count ? h->items[0].value : janet_wrap_nil();
+}
+
+JANET_CORE_FN(cfun_heap_update,
+              "(heap/update heap handle x)",
+              "Replace the value of the item with the given handle by x, and move the item to "
+              "its new place. This is the decrease-key operation of a priority queue, but the "
+              "new value may also come later than the old one. Returns the heap.") {
+    janet_fixarity(argc, 3);
+    JanetHeap *h = janet_getabstract(argv, 0, &janet_heap_type);
+    int32_t handle = janet_getinteger(argv, 1);
+    if (handle < 0 || handle >= h->handle_count || h->positions[handle] < 0) {
+        janet_panicf("handle %d is not in the heap", handle);
+    }
+    int32_t i = h->positions[handle];
+    h->items[i].value = argv[2];
+    if (heap_sift_up(h, i) == i) heap_sift_down(h, i);
+    return argv[0];
+}
+
+/* Module entry point */
+void janet_lib_heap(JanetTable *env) {
+    JanetRegExt heap_cfuns[] = {
+        JANET_CORE_REG("heap/new", cfun_heap_new),
+        JANET_CORE_REG("heap/from", cfun_heap_from),
+        JANET_CORE_REG("heap/push", cfun_heap_push),
+        JANET_CORE_REG("heap/pop", cfun_heap_pop),
+        JANET_CORE_REG("heap/peek", cfun_heap_peek),
+        JANET_CORE_REG("heap/update", cfun_heap_update),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, heap_cfuns);
+    janet_register_abstract_type(&janet_heap_type);
+}
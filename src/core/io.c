@@ -577,14 +577,15 @@ JANET_CORE_FN(cfun_io_xprin,
 static Janet cfun_io_printf_impl_x(int32_t argc, Janet *argv, int newline,
                                    FILE *dflt_file, int32_t offset, Janet x) {
     FILE *f;
-    const char *fmt = janet_getcstring(argv, offset);
+    Janet fmt = janet_getformat(argv, offset);
+    if (janet_checktype(fmt, JANET_STRING)) janet_getcstring(argv, offset); /* check for embedded 0s */
     switch (janet_type(x)) {
         default:
             janet_panicf("cannot print to %v", x);
         case JANET_BUFFER: {
             /* Special case buffer */
             JanetBuffer *buf = janet_unwrap_buffer(x);
-            janet_buffer_format(buf, fmt, offset, argc, argv);
+            janet_buffer_format_value(buf, fmt, offset, argc, argv);
             if (newline) janet_buffer_push_u8(buf, '\n');
             return janet_wrap_nil();
         }
@@ -602,7 +603,7 @@ static Janet cfun_io_printf_impl_x(int32_t argc, Janet *argv, int newline,
         }
     }
     JanetBuffer *buf = janet_buffer(10);
-    janet_buffer_format(buf, fmt, offset, argc, argv);
+    janet_buffer_format_value(buf, fmt, offset, argc, argv);
     if (newline) janet_buffer_push_u8(buf, '\n');
     if (buf->count) {
         if (1 != fwrite(buf->data, buf->count, 1, f)) {
@@ -0,0 +1,431 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+/*
+ * Lazy iterators. An iterator is a source data structure plus a list of
+ * stages (map, filter, take, ...). Stacking a stage on an iterator copies
+ * the stage list rather than wrapping the old iterator, so a pipeline of any
+ * length is a single object, and each value runs through all of the stages
+ * before the next one is pulled from the source. No intermediate arrays are
+ * made.
+ *
+ * Iterators also implement the next and get hooks with the keys 0, 1, 2, ...
+ * so that each, map, reduce and the other functions in the core library can
+ * consume them. Each iterator remembers one cursor position. Asking for an
+ * earlier key restarts the pipeline from the beginning of the source.
+ */
+
+typedef enum {
+    JANET_ITER_MAP,
+    JANET_ITER_FILTER,
+    JANET_ITER_KEEP,
+    JANET_ITER_MAPCAT,
+    JANET_ITER_TAKE,
+    JANET_ITER_TAKE_WHILE,
+    JANET_ITER_DROP,
+    JANET_ITER_DROP_WHILE
+} JanetIterStageKind;
+
+typedef struct {
+    JanetIterStageKind kind;
+    Janet f;
+    int32_t n;
+    /* Cursor state. seen counts values for take and drop, and is set
+     * once drop-while has stopped dropping. */
+    int32_t seen;
+    Janet inner;
+    Janet inner_key;
+} JanetIterStage;
+
+typedef struct {
+    Janet source;
+    JanetIterStage *stages;
+    int32_t stage_count;
+    /* Cursor. index is the key of value, or -1 before the first value. */
+    Janet source_key;
+    Janet value;
+    int32_t index;
+    int done;
+} JanetIter;
+
+static void iter_reset(JanetIter *it) {
+    it->source_key = janet_wrap_nil();
+    it->value = janet_wrap_nil();
+    it->index = -1;
+    it->done = 0;
+    for (int32_t i = 0; i < it->stage_count; i++) {
+        it->stages[i].seen = 0;
+        it->stages[i].inner = janet_wrap_nil();
+        it->stages[i].inner_key = janet_wrap_nil();
+    }
+}
+
+/* Get the next value out of the pipeline. Returns 0 when the iterator is
+ * exhausted. */
+static int iter_pull(JanetIter *it, Janet *out) {
+    if (it->done) return 0;
+    for (;;) {
+        Janet x;
+        int32_t k;
+
+        /* Finish the innermost mapcat that still has values before pulling
+         * from the source. A take found first has already let through all
+         * it will, so nothing else can come out. */
+        for (k = it->stage_count - 1; k >= 0; k--) {
+            JanetIterStage *s = it->stages + k;
+            if (s->kind == JANET_ITER_MAPCAT && !janet_checktype(s->inner_key, JANET_NIL)) break;
+            if (s->kind == JANET_ITER_TAKE && s->seen >= s->n) goto stop;
+        }
+        if (k >= 0) {
+            JanetIterStage *s = it->stages + k;
+            s->inner_key = janet_next(s->inner, s->inner_key);
+            if (janet_checktype(s->inner_key, JANET_NIL)) {
+                s->inner = janet_wrap_nil();
+                continue;
+            }
+            x = janet_in(s->inner, s->inner_key);
+            k++;
+        } else {
+            it->source_key = janet_next(it->source, it->source_key);
+            if (janet_checktype(it->source_key, JANET_NIL)) goto stop;
+            x = janet_in(it->source, it->source_key);
+            k = 0;
+        }
+
+        for (; k < it->stage_count; k++) {
+            JanetIterStage *s = it->stages + k;
+            switch (s->kind) {
+                case JANET_ITER_MAP:
+                    x = janet_call_value(s->f, 1, &x);
+                    break;
+                case JANET_ITER_FILTER:
+                    if (!janet_truthy(janet_call_value(s->f, 1, &x))) goto skip;
+                    break;
+                case JANET_ITER_KEEP:
+                    x = janet_call_value(s->f, 1, &x);
+                    if (!janet_truthy(x)) goto skip;
+                    break;
+                case JANET_ITER_MAPCAT:
+                    s->inner = janet_call_value(s->f, 1, &x);
+                    s->inner_key = janet_next(s->inner, janet_wrap_nil());
+                    if (janet_checktype(s->inner_key, JANET_NIL)) {
+                        s->inner = janet_wrap_nil();
+                        goto skip;
+                    }
+                    x = janet_in(s->inner, s->inner_key);
+                    break;
+                case JANET_ITER_TAKE:
+                    if (s->seen >= s->n) goto stop;
+                    s->seen++;
+                    break;
+                case JANET_ITER_TAKE_WHILE:
+                    if (!janet_truthy(janet_call_value(s->f, 1, &x))) goto stop;
+                    break;
+                case JANET_ITER_DROP:
+                    if (s->seen < s->n) {
+                        s->seen++;
+                        goto skip;
+                    }
+                    break;
+                case JANET_ITER_DROP_WHILE:
+                    if (!s->seen) {
+                        if (janet_truthy(janet_call_value(s->f, 1, &x))) goto skip;
+                        s->seen = 1;
+                    }
+                    break;
+            }
+        }
+        *out = x;
+        return 1;
+    skip:
+        ;
+    }
+stop:
+    it->done = 1;
+    return 0;
+}
+
+/* Move the cursor to the value with key index. */
+static int iter_seek(JanetIter *it, int32_t index) {
+    if (index == it->index) return 1;
+    if (index < it->index) iter_reset(it);
+    while (it->index < index) {
+        Janet x;
+        if (!iter_pull(it, &x)) return 0;
+        if (it->index == INT32_MAX) janet_panic("iterator overflow");
+        it->value = x;
+        it->index++;
+    }
+    return 1;
+}
+
+static int iter_gc(void *p, size_t size) {
+    (void) size;
+    JanetIter *it = (JanetIter *) p;
+    janet_free(it->stages);
+    return 0;
+}
+
+static int iter_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetIter *it = (JanetIter *) p;
+    janet_mark(it->source);
+    janet_mark(it->source_key);
+    janet_mark(it->value);
+    for (int32_t i = 0; i < it->stage_count; i++) {
+        janet_mark(it->stages[i].f);
+        janet_mark(it->stages[i].inner);
+        janet_mark(it->stages[i].inner_key);
+    }
+    return 0;
+}
+
+static int iter_get(void *p, Janet key, Janet *out) {
+    JanetIter *it = (JanetIter *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t index = janet_unwrap_integer(key);
+    if (index < 0 || !iter_seek(it, index)) return 0;
+    *out = it->value;
+    return 1;
+}
+
+static Janet iter_next(void *p, Janet key) {
+    JanetIter *it = (JanetIter *) p;
+    int32_t index;
+    if (janet_checktype(key, JANET_NIL)) {
+        index = 0;
+    } else if (janet_checkint(key) && janet_unwrap_integer(key) >= 0
+               && janet_unwrap_integer(key) < INT32_MAX) {
+        index = janet_unwrap_integer(key) + 1;
+    } else {
+        return janet_wrap_nil();
+    }
+    return iter_seek(it, index) ? janet_wrap_integer(index) : janet_wrap_nil();
+}
+
+static const JanetAbstractType janet_iter_type = {
+    "core/iterator",
+    iter_gc,
+    iter_gcmark,
+    iter_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    iter_next,
+    JANET_ATEND_NEXT
+};
+
+/* Make a new iterator over x with room for extra more stages. If x is an
+ * iterator, the new one starts with a copy of its stages. */
+static JanetIter *iter_derive(Janet x, int32_t extra) {
+    JanetIter *parent = janet_checkabstract(x, &janet_iter_type);
+    JanetIter *it = janet_abstract(&janet_iter_type, sizeof(JanetIter));
+    it->source = parent ? parent->source : x;
+    it->stage_count = parent ? parent->stage_count : 0;
+    it->stages = NULL;
+    if (it->stage_count + extra > 0) {
+        it->stages = janet_malloc((it->stage_count + extra) * sizeof(JanetIterStage));
+        if (NULL == it->stages) {
+            JANET_OUT_OF_MEMORY;
+        }
+        if (parent) {
+            memcpy(it->stages, parent->stages, parent->stage_count * sizeof(JanetIterStage));
+        }
+    }
+    iter_reset(it);
+    return it;
+}
+
+static Janet iter_stage(JanetIterStageKind kind, Janet f, int32_t n, Janet x) {
+    JanetIter *it = iter_derive(x, 1);
+    JanetIterStage *s = it->stages + it->stage_count++;
+    s->kind = kind;
+    s->f = f;
+    s->n = n;
+    s->seen = 0;
+    s->inner = janet_wrap_nil();
+    s->inner_key = janet_wrap_nil();
+    return janet_wrap_abstract(it);
+}
+
+JANET_CORE_FN(cfun_iter_of,
+              "(iter/of ds)",
+              "Create a lazy iterator over the values of a data structure. Anything that works "
+              "with each can be a source, including fibers and other iterators. A fiber can only "
+              "be iterated once.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_abstract(iter_derive(argv[0], 0));
+}
+
+JANET_CORE_FN(cfun_iter_map,
+              "(iter/map f ds)",
+              "Create a lazy iterator over (f x) for each value x in ds. ds can be any iterable "
+              "data structure or another iterator.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_MAP, argv[0], 0, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_filter,
+              "(iter/filter pred ds)",
+              "Create a lazy iterator over the values x in ds for which (pred x) is truthy.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_FILTER, argv[0], 0, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_keep,
+              "(iter/keep pred ds)",
+              "Create a lazy iterator over the truthy results of (pred x) for each value x in ds.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_KEEP, argv[0], 0, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_mapcat,
+              "(iter/mapcat f ds)",
+              "Create a lazy iterator over the values of each (f x) in turn, for each value x in ds.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_MAPCAT, argv[0], 0, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_take,
+              "(iter/take n ds)",
+              "Create a lazy iterator over the first n values of ds. No more values are pulled "
+              "from ds once n have been taken.") {
+    janet_fixarity(argc, 2);
+    int32_t n = janet_getinteger(argv, 0);
+    return iter_stage(JANET_ITER_TAKE, janet_wrap_nil(), n < 0 ? 0 : n, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_take_while,
+              "(iter/take-while pred ds)",
+              "Create a lazy iterator over the values of ds up to the first one for which "
+              "(pred x) is falsey.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_TAKE_WHILE, argv[0], 0, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_drop,
+              "(iter/drop n ds)",
+              "Create a lazy iterator that skips the first n values of ds.") {
+    janet_fixarity(argc, 2);
+    int32_t n = janet_getinteger(argv, 0);
+    return iter_stage(JANET_ITER_DROP, janet_wrap_nil(), n < 0 ? 0 : n, argv[1]);
+}
+
+JANET_CORE_FN(cfun_iter_drop_while,
+              "(iter/drop-while pred ds)",
+              "Create a lazy iterator that skips values of ds while (pred x) is truthy.") {
+    janet_fixarity(argc, 2);
+    return iter_stage(JANET_ITER_DROP_WHILE, argv[0], 0, argv[1]);
+}
+
+typedef struct {
+    JanetIter *it;
+    Janet (*step)(Janet acc, Janet x, void *data);
+    void *data;
+} JanetIterDrain;
+
+static void iter_drain_run(void *data) {
+    JanetIterDrain *drain = (JanetIterDrain *) data;
+    JanetIter *it = drain->it;
+    Janet y;
+    while (iter_pull(it, &y)) {
+        it->value = drain->step(it->value, y, drain->data);
+        janet_gccheck();
+    }
+}
+
+/* Run a fresh copy of the iterator x to the end, passing each value to step
+ * together with the accumulator, which is kept in the copy's value slot.
+ * Long pipelines would otherwise hold all of the garbage made by their
+ * callbacks until they finish, so the copy is rooted and the collector gets
+ * to run between values. */
+static Janet iter_drain(Janet x, Janet acc, Janet (*step)(Janet acc, Janet x, void *data), void *data) {
+    JanetIterDrain drain;
+    drain.it = iter_derive(x, 0);
+    drain.it->value = acc;
+    drain.step = step;
+    drain.data = data;
+    Janet root = janet_wrap_abstract(drain.it);
+    janet_gcrooted(&root, 1, iter_drain_run, &drain);
+    return drain.it->value;
+}
+
+static Janet iter_reduce_step(Janet acc, Janet x, void *data) {
+    Janet args[2];
+    args[0] = acc;
+    args[1] = x;
+    return janet_call_value(*((Janet *) data), 2, args);
+}
+
+static Janet iter_collect_step(Janet acc, Janet x, void *data) {
+    (void) data;
+    janet_array_push(janet_unwrap_array(acc), x);
+    return acc;
+}
+
+JANET_CORE_FN(cfun_iter_reduce,
+              "(iter/reduce f init ds)",
+              "Reduce the values of an iterator or data structure with f, like reduce, but "
+              "run the whole pipeline in one loop in C. The cursor of an iterator passed in "
+              "is not moved.") {
+    janet_fixarity(argc, 3);
+    return iter_drain(argv[2], argv[1], iter_reduce_step, argv);
+}
+
+JANET_CORE_FN(cfun_iter_collect,
+              "(iter/collect ds &opt into)",
+              "Run an iterator to the end and push all of its values to the array into, "
+              "or to a new array. Returns the array.") {
+    janet_arity(argc, 1, 2);
+    JanetArray *array = (argc > 1) ? janet_getarray(argv, 1) : janet_array(0);
+    return iter_drain(argv[0], janet_wrap_array(array), iter_collect_step, NULL);
+}
+
+/* Module entry point */
+void janet_lib_iter(JanetTable *env) {
+    JanetRegExt iter_cfuns[] = {
+        JANET_CORE_REG("iter/of", cfun_iter_of),
+        JANET_CORE_REG("iter/map", cfun_iter_map),
+        JANET_CORE_REG("iter/filter", cfun_iter_filter),
+        JANET_CORE_REG("iter/keep", cfun_iter_keep),
+        JANET_CORE_REG("iter/mapcat", cfun_iter_mapcat),
+        JANET_CORE_REG("iter/take", cfun_iter_take),
+        JANET_CORE_REG("iter/take-while", cfun_iter_take_while),
+        JANET_CORE_REG("iter/drop", cfun_iter_drop),
+        JANET_CORE_REG("iter/drop-while", cfun_iter_drop_while),
+        JANET_CORE_REG("iter/reduce", cfun_iter_reduce),
+        JANET_CORE_REG("iter/collect", cfun_iter_collect),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, iter_cfuns);
+    janet_register_abstract_type(&janet_iter_type);
+}
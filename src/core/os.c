@@ -191,6 +191,30 @@ JANET_CORE_FN(os_arch,
 #undef janet_stringify1
 #undef janet_stringify
 
+#ifndef JANET_REDUCED_OS
+
+JANET_CORE_FN(os_cpu_count,
+              "(os/cpu-count &opt dflt)",
+              "Get an approximate number of CPUs available to this process. If the number "
+              "cannot be determined, returns dflt.") {
+    janet_arity(argc, 0, 1);
+    Janet dflt = argc > 0 ? argv[0] : janet_wrap_nil();
+#ifdef JANET_WINDOWS
+    (void) dflt;
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return janet_wrap_integer((int32_t) info.dwNumberOfProcessors);
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1 || count > INT32_MAX) return dflt;
+    return janet_wrap_integer((int32_t) count);
+#else
+    return dflt;
+#endif
+}
+
+#endif
+
 JANET_CORE_FN(os_exit,
               "(os/exit &opt x)",
               "Exit from janet with an exit code equal to x. If x is not an integer, "
@@ -816,10 +840,10 @@ static Janet os_execute_impl(int32_t argc, Janet *argv, int is_spawn) {
 
     /* Get optional redirections */
     if (argc > 2) {
-        JanetDictView tab = janet_getdictionary(argv, 2);
-        Janet maybe_stdin = janet_dictionary_get(tab.kvs, tab.cap, janet_ckeywordv("in"));
-        Janet maybe_stdout = janet_dictionary_get(tab.kvs, tab.cap, janet_ckeywordv("out"));
-        Janet maybe_stderr = janet_dictionary_get(tab.kvs, tab.cap, janet_ckeywordv("err"));
+        janet_getdictionary(argv, 2);
+        Janet maybe_stdin = janet_get(argv[2], janet_ckeywordv("in"));
+        Janet maybe_stdout = janet_get(argv[2], janet_ckeywordv("out"));
+        Janet maybe_stderr = janet_get(argv[2], janet_ckeywordv("err"));
         if (janet_keyeq(maybe_stdin, "pipe")) {
             new_in = make_pipes(&pipe_in, 1, &pipe_errflag);
             pipe_owner_flags |= JANET_PROC_OWNS_STDIN;
@@ -2164,6 +2188,7 @@ void janet_lib_os(JanetTable *env) {
         JANET_CORE_REG("os/which", os_which),
         JANET_CORE_REG("os/arch", os_arch),
 #ifndef JANET_REDUCED_OS
+        JANET_CORE_REG("os/cpu-count", os_cpu_count),
         JANET_CORE_REG("os/environ", os_environ),
         JANET_CORE_REG("os/getenv", os_getenv),
         JANET_CORE_REG("os/dir", os_dir),
@@ -0,0 +1,1095 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+
+/*
+ * Persistent vectors and hash maps. Updates copy only the path from the root
+ * to the changed leaf, so every version shares most of its structure with
+ * the one it came from.
+ *
+ * Vectors are 32 way tries of leaves with a separate tail leaf that takes
+ * pushes. Maps are hash array mapped tries in the compressed (CHAMP) layout:
+ * a node keeps its inline entries ahead of its sub nodes, and keys whose 32
+ * bit hashes are equal end up together in a collision node.
+ *
+ * Transients are the mutable builders for both. Every node records the id of
+ * the transient that created it, and a transient changes the nodes it owns in
+ * place instead of copying them. Persistent updates use the id 0, which owns
+ * nothing.
+ */
+
+#define JANET_PBITS 5
+#define JANET_PWIDTH (1 << JANET_PBITS)
+#define JANET_PMASK (JANET_PWIDTH - 1)
+
+/* Deeper map nodes have run out of hash bits and are collision nodes */
+#define JANET_PMAP_MAXSHIFT 30
+
+static JANET_THREAD_LOCAL uint64_t janet_pedit_count = 0;
+
+static uint64_t janet_pedit_new(void) {
+    return ++janet_pedit_count;
+}
+
+#ifdef __GNUC__
+#define janet_popcount32(x) __builtin_popcount(x)
+#else
+static int janet_popcount32(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+#endif
+
+/*
+ * Vector nodes
+ */
+
+/* Leaves hold values, branches hold wrapped child nodes */
+typedef struct {
+    uint64_t edit;
+    Janet slots[JANET_PWIDTH];
+} JanetPVecNode;
+
+typedef struct {
+    int32_t count;
+    int32_t shift;
+    int32_t hash;
+    uint64_t edit;
+    JanetPVecNode *root;
+    JanetPVecNode *tail;
+} JanetPVec;
+
+static int pvnode_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetPVecNode *node = (JanetPVecNode *) p;
+    for (int32_t i = 0; i < JANET_PWIDTH; i++) {
+        janet_mark(node->slots[i]);
+    }
+    return 0;
+}
+
+static const JanetAbstractType janet_pvec_node_type = {
+    "core/pvec-node",
+    NULL,
+    pvnode_gcmark,
+    JANET_ATEND_GCMARK
+};
+
+static JanetPVecNode *pvnode_new(uint64_t edit) {
+    JanetPVecNode *node = janet_abstract(&janet_pvec_node_type, sizeof(JanetPVecNode));
+    node->edit = edit;
+    for (int32_t i = 0; i < JANET_PWIDTH; i++) {
+        node->slots[i] = janet_wrap_nil();
+    }
+    return node;
+}
+
+static JanetPVecNode *pvnode_editable(JanetPVecNode *node, uint64_t edit) {
+    if (edit && node->edit == edit) return node;
+    JanetPVecNode *copy = janet_abstract(&janet_pvec_node_type, sizeof(JanetPVecNode));
+    copy->edit = edit;
+    memcpy(copy->slots, node->slots, sizeof(node->slots));
+    return copy;
+}
+
+#define pvnode_child(node, i) ((JanetPVecNode *) janet_unwrap_abstract((node)->slots[(i)]))
+
+static int32_t pvec_tailoff(JanetPVec *v) {
+    return v->count < JANET_PWIDTH ? 0 : ((v->count - 1) >> JANET_PBITS) << JANET_PBITS;
+}
+
+/* Get the leaf holding index i */
+static JanetPVecNode *pvec_leaf(JanetPVec *v, int32_t i) {
+    if (i >= pvec_tailoff(v)) return v->tail;
+    JanetPVecNode *node = v->root;
+    for (int32_t level = v->shift; level > 0; level -= JANET_PBITS) {
+        node = pvnode_child(node, (i >> level) & JANET_PMASK);
+    }
+    return node;
+}
+
+static JanetPVecNode *pvec_new_path(uint64_t edit, int32_t level, JanetPVecNode *node) {
+    for (; level > 0; level -= JANET_PBITS) {
+        JanetPVecNode *parent = pvnode_new(edit);
+        parent->slots[0] = janet_wrap_abstract(node);
+        node = parent;
+    }
+    return node;
+}
+
+static JanetPVecNode *pvec_push_tail(JanetPVec *v, uint64_t edit, int32_t level,
+                                     JanetPVecNode *parent, JanetPVecNode *tail) {
+    int32_t sub = ((v->count - 1) >> level) & JANET_PMASK;
+    JanetPVecNode *ret = pvnode_editable(parent, edit);
+    JanetPVecNode *insert;
+    if (level == JANET_PBITS) {
+        insert = tail;
+    } else if (janet_checktype(parent->slots[sub], JANET_NIL)) {
+        insert = pvec_new_path(edit, level - JANET_PBITS, tail);
+    } else {
+        insert = pvec_push_tail(v, edit, level - JANET_PBITS, pvnode_child(parent, sub), tail);
+    }
+    ret->slots[sub] = janet_wrap_abstract(insert);
+    return ret;
+}
+
+static void pvec_push(JanetPVec *v, uint64_t edit, Janet x) {
+    if (v->count == INT32_MAX) janet_panic("vector overflow");
+    int32_t tailcount = v->count - pvec_tailoff(v);
+    if (tailcount < JANET_PWIDTH) {
+        v->tail = pvnode_editable(v->tail, edit);
+        v->tail->slots[tailcount] = x;
+    } else {
+        /* Move the full tail into the trie, adding a level if the root is full */
+        JanetPVecNode *root;
+        if ((v->count >> JANET_PBITS) > (1 << v->shift)) {
+            root = pvnode_new(edit);
+            root->slots[0] = janet_wrap_abstract(v->root);
+            root->slots[1] = janet_wrap_abstract(pvec_new_path(edit, v->shift, v->tail));
+            v->shift += JANET_PBITS;
+        } else {
+            root = pvec_push_tail(v, edit, v->shift, v->root, v->tail);
+        }
+        v->root = root;
+        v->tail = pvnode_new(edit);
+        v->tail->slots[0] = x;
+    }
+    v->count++;
+    v->hash = 0;
+}
+
+static JanetPVecNode *pvec_do_assoc(uint64_t edit, int32_t level, JanetPVecNode *node,
+                                    int32_t i, Janet x) {
+    JanetPVecNode *ret = pvnode_editable(node, edit);
+    if (level == 0) {
+        ret->slots[i & JANET_PMASK] = x;
+    } else {
+        int32_t sub = (i >> level) & JANET_PMASK;
+        JanetPVecNode *child = pvec_do_assoc(edit, level - JANET_PBITS, pvnode_child(node, sub), i, x);
+        ret->slots[sub] = janet_wrap_abstract(child);
+    }
+    return ret;
+}
+
+/* Set index i, where i may be one past the end */
+static void pvec_assoc(JanetPVec *v, uint64_t edit, int32_t i, Janet x) {
+    if (i == v->count) {
+        pvec_push(v, edit, x);
+        return;
+    }
+    if (i >= pvec_tailoff(v)) {
+        v->tail = pvnode_editable(v->tail, edit);
+        v->tail->slots[i & JANET_PMASK] = x;
+    } else {
+        v->root = pvec_do_assoc(edit, v->shift, v->root, i, x);
+    }
+    v->hash = 0;
+}
+
+/* Remove the rightmost leaf. Returns NULL if the node becomes empty. */
+static JanetPVecNode *pvec_pop_tail(JanetPVec *v, uint64_t edit, int32_t level, JanetPVecNode *node) {
+    int32_t sub = ((v->count - 2) >> level) & JANET_PMASK;
+    if (level > JANET_PBITS) {
+        JanetPVecNode *child = pvec_pop_tail(v, edit, level - JANET_PBITS, pvnode_child(node, sub));
+        if (child == NULL && sub == 0) return NULL;
+        JanetPVecNode *ret = pvnode_editable(node, edit);
+        ret->slots[sub] = child == NULL ? janet_wrap_nil() : janet_wrap_abstract(child);
+        return ret;
+    } else if (sub == 0) {
+        return NULL;
+    } else {
+        JanetPVecNode *ret = pvnode_editable(node, edit);
+        ret->slots[sub] = janet_wrap_nil();
+        return ret;
+    }
+}
+
+static void pvec_pop(JanetPVec *v, uint64_t edit) {
+    int32_t tailcount = v->count - pvec_tailoff(v);
+    if (tailcount > 1 || v->count == 1) {
+        v->tail = pvnode_editable(v->tail, edit);
+        v->tail->slots[tailcount - 1] = janet_wrap_nil();
+    } else {
+        /* The last leaf of the trie becomes the tail */
+        JanetPVecNode *tail = pvec_leaf(v, v->count - 2);
+        JanetPVecNode *root = pvec_pop_tail(v, edit, v->shift, v->root);
+        if (root == NULL) root = pvnode_new(edit);
+        if (v->shift > JANET_PBITS && janet_checktype(root->slots[1], JANET_NIL)) {
+            root = pvnode_child(root, 0);
+            v->shift -= JANET_PBITS;
+        }
+        v->root = root;
+        v->tail = tail;
+    }
+    v->count--;
+    v->hash = 0;
+}
+
+static Janet pvec_ref(JanetPVec *v, int32_t i) {
+    return pvec_leaf(v, i)->slots[i & JANET_PMASK];
+}
+
+/*
+ * Map nodes
+ */
+
+/* Inline key value pairs come first, then wrapped child nodes. Collision
+ * nodes have no bitmaps and hold only pairs. */
+typedef struct {
+    uint64_t edit;
+    uint32_t datamap;
+    uint32_t nodemap;
+    int32_t length;
+    Janet slots[];
+} JanetPMapNode;
+
+typedef struct {
+    int32_t count;
+    int32_t hash;
+    uint64_t edit;
+    JanetPMapNode *root;
+} JanetPMap;
+
+static int pmnode_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetPMapNode *node = (JanetPMapNode *) p;
+    for (int32_t i = 0; i < node->length; i++) {
+        janet_mark(node->slots[i]);
+    }
+    return 0;
+}
+
+static const JanetAbstractType janet_pmap_node_type = {
+    "core/pmap-node",
+    NULL,
+    pmnode_gcmark,
+    JANET_ATEND_GCMARK
+};
+
+static JanetPMapNode *pmnode_new(uint64_t edit, uint32_t datamap, uint32_t nodemap, int32_t length) {
+    JanetPMapNode *node = janet_abstract(&janet_pmap_node_type,
+                                         sizeof(JanetPMapNode) + length * sizeof(Janet));
+    node->edit = edit;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->length = length;
+    return node;
+}
+
+static JanetPMapNode *pmnode_editable(JanetPMapNode *node, uint64_t edit) {
+    if (edit && node->edit == edit) return node;
+    JanetPMapNode *copy = pmnode_new(edit, node->datamap, node->nodemap, node->length);
+    memcpy(copy->slots, node->slots, node->length * sizeof(Janet));
+    return copy;
+}
+
+#define pmnode_child(node, i) ((JanetPMapNode *) janet_unwrap_abstract((node)->slots[(i)]))
+#define pm_bit(hash, shift) (1u << (((hash) >> (shift)) & JANET_PMASK))
+#define pm_index(map, bit) janet_popcount32((map) & ((bit) - 1))
+
+static int32_t pmnode_pairs(JanetPMapNode *node, int32_t shift) {
+    return shift > JANET_PMAP_MAXSHIFT ? node->length / 2 : janet_popcount32(node->datamap);
+}
+
+/* Find the key value pair for a key, or NULL */
+static const Janet *pmap_find(JanetPMapNode *node, uint32_t hash, Janet key) {
+    for (int32_t shift = 0;; shift += JANET_PBITS) {
+        if (shift > JANET_PMAP_MAXSHIFT) {
+            for (int32_t i = 0; i < node->length; i += 2) {
+                if (janet_equals(node->slots[i], key)) return node->slots + i;
+            }
+            return NULL;
+        }
+        uint32_t bit = pm_bit(hash, shift);
+        if (node->datamap & bit) {
+            const Janet *kv = node->slots + 2 * pm_index(node->datamap, bit);
+            return janet_equals(kv[0], key) ? kv : NULL;
+        }
+        if (!(node->nodemap & bit)) return NULL;
+        int32_t ndata = janet_popcount32(node->datamap);
+        node = pmnode_child(node, 2 * ndata + pm_index(node->nodemap, bit));
+    }
+}
+
+/* Make a node holding two pairs whose keys first differ at shift */
+static JanetPMapNode *pmap_merge(uint64_t edit, int32_t shift,
+                                 uint32_t h0, Janet k0, Janet v0,
+                                 uint32_t h1, Janet k1, Janet v1) {
+    JanetPMapNode *node;
+    if (shift > JANET_PMAP_MAXSHIFT) {
+        node = pmnode_new(edit, 0, 0, 4);
+    } else {
+        uint32_t b0 = pm_bit(h0, shift);
+        uint32_t b1 = pm_bit(h1, shift);
+        if (b0 == b1) {
+            node = pmnode_new(edit, 0, b0, 1);
+            node->slots[0] = janet_wrap_abstract(pmap_merge(edit, shift + JANET_PBITS, h0, k0, v0, h1, k1, v1));
+            return node;
+        }
+        node = pmnode_new(edit, b0 | b1, 0, 4);
+        if (b1 < b0) {
+            node->slots[0] = k1;
+            node->slots[1] = v1;
+            node->slots[2] = k0;
+            node->slots[3] = v0;
+            return node;
+        }
+    }
+    node->slots[0] = k0;
+    node->slots[1] = v0;
+    node->slots[2] = k1;
+    node->slots[3] = v1;
+    return node;
+}
+
+static JanetPMapNode *pmap_assoc(JanetPMapNode *node, uint64_t edit, int32_t shift,
+                                 uint32_t hash, Janet key, Janet value, int *added) {
+    JanetPMapNode *ret;
+    if (shift > JANET_PMAP_MAXSHIFT) {
+        for (int32_t i = 0; i < node->length; i += 2) {
+            if (janet_equals(node->slots[i], key)) {
+                if (janet_equals(node->slots[i + 1], value)) return node;
+                ret = pmnode_editable(node, edit);
+                ret->slots[i + 1] = value;
+                return ret;
+            }
+        }
+        ret = pmnode_new(edit, 0, 0, node->length + 2);
+        memcpy(ret->slots, node->slots, node->length * sizeof(Janet));
+        ret->slots[node->length] = key;
+        ret->slots[node->length + 1] = value;
+        *added = 1;
+        return ret;
+    }
+    uint32_t bit = pm_bit(hash, shift);
+    int32_t ndata = janet_popcount32(node->datamap);
+    if (node->datamap & bit) {
+        int32_t i = 2 * pm_index(node->datamap, bit);
+        Janet oldkey = node->slots[i];
+        if (janet_equals(oldkey, key)) {
+            if (janet_equals(node->slots[i + 1], value)) return node;
+            ret = pmnode_editable(node, edit);
+            ret->slots[i + 1] = value;
+            return ret;
+        }
+        /* Push the existing pair down into a new sub node with the new one */
+        JanetPMapNode *child = pmap_merge(edit, shift + JANET_PBITS,
+                                          (uint32_t) janet_hash(oldkey), oldkey, node->slots[i + 1],
+                                          hash, key, value);
+        int32_t j = pm_index(node->nodemap, bit);
+        int32_t nnodes = node->length - 2 * ndata;
+        ret = pmnode_new(edit, node->datamap ^ bit, node->nodemap | bit, node->length - 1);
+        Janet *dst = ret->slots + 2 * ndata - 2;
+        const Janet *src = node->slots + 2 * ndata;
+        memcpy(ret->slots, node->slots, i * sizeof(Janet));
+        memcpy(ret->slots + i, node->slots + i + 2, (2 * ndata - i - 2) * sizeof(Janet));
+        memcpy(dst, src, j * sizeof(Janet));
+        dst[j] = janet_wrap_abstract(child);
+        memcpy(dst + j + 1, src + j, (nnodes - j) * sizeof(Janet));
+        *added = 1;
+        return ret;
+    }
+    if (node->nodemap & bit) {
+        int32_t i = 2 * ndata + pm_index(node->nodemap, bit);
+        JanetPMapNode *child = pmnode_child(node, i);
+        JanetPMapNode *newchild = pmap_assoc(child, edit, shift + JANET_PBITS, hash, key, value, added);
+        if (newchild == child) return node;
+        ret = pmnode_editable(node, edit);
+        ret->slots[i] = janet_wrap_abstract(newchild);
+        return ret;
+    }
+    int32_t i = 2 * pm_index(node->datamap, bit);
+    ret = pmnode_new(edit, node->datamap | bit, node->nodemap, node->length + 2);
+    memcpy(ret->slots, node->slots, i * sizeof(Janet));
+    ret->slots[i] = key;
+    ret->slots[i + 1] = value;
+    memcpy(ret->slots + i + 2, node->slots + i, (node->length - i) * sizeof(Janet));
+    *added = 1;
+    return ret;
+}
+
+/* Remove a key. A sub node left with a single pair is folded back into its
+ * parent, so sub nodes always hold at least two pairs. */
+static JanetPMapNode *pmap_dissoc(JanetPMapNode *node, uint64_t edit, int32_t shift,
+                                  uint32_t hash, Janet key, int *removed) {
+    JanetPMapNode *ret;
+    if (shift > JANET_PMAP_MAXSHIFT) {
+        for (int32_t i = 0; i < node->length; i += 2) {
+            if (janet_equals(node->slots[i], key)) {
+                ret = pmnode_new(edit, 0, 0, node->length - 2);
+                memcpy(ret->slots, node->slots, i * sizeof(Janet));
+                memcpy(ret->slots + i, node->slots + i + 2, (node->length - i - 2) * sizeof(Janet));
+                *removed = 1;
+                return ret;
+            }
+        }
+        return node;
+    }
+    uint32_t bit = pm_bit(hash, shift);
+    if (node->datamap & bit) {
+        int32_t i = 2 * pm_index(node->datamap, bit);
+        if (!janet_equals(node->slots[i], key)) return node;
+        ret = pmnode_new(edit, node->datamap ^ bit, node->nodemap, node->length - 2);
+        memcpy(ret->slots, node->slots, i * sizeof(Janet));
+        memcpy(ret->slots + i, node->slots + i + 2, (node->length - i - 2) * sizeof(Janet));
+        *removed = 1;
+        return ret;
+    }
+    if (node->nodemap & bit) {
+        int32_t i = 2 * janet_popcount32(node->datamap) + pm_index(node->nodemap, bit);
+        JanetPMapNode *child = pmnode_child(node, i);
+        JanetPMapNode *newchild = pmap_dissoc(child, edit, shift + JANET_PBITS, hash, key, removed);
+        if (newchild == child) return node;
+        if (newchild->nodemap == 0 && newchild->length == 2) {
+            int32_t d = 2 * pm_index(node->datamap, bit);
+            ret = pmnode_new(edit, node->datamap | bit, node->nodemap ^ bit, node->length + 1);
+            memcpy(ret->slots, node->slots, d * sizeof(Janet));
+            ret->slots[d] = newchild->slots[0];
+            ret->slots[d + 1] = newchild->slots[1];
+            memcpy(ret->slots + d + 2, node->slots + d, (i - d) * sizeof(Janet));
+            memcpy(ret->slots + i + 2, node->slots + i + 1, (node->length - i - 1) * sizeof(Janet));
+            return ret;
+        }
+        ret = pmnode_editable(node, edit);
+        ret->slots[i] = janet_wrap_abstract(newchild);
+        return ret;
+    }
+    return node;
+}
+
+static Janet pmnode_first(JanetPMapNode *node, int32_t shift) {
+    while (shift <= JANET_PMAP_MAXSHIFT && node->datamap == 0) {
+        node = pmnode_child(node, 0);
+        shift += JANET_PBITS;
+    }
+    return node->slots[0];
+}
+
+#define JANET_PMAP_NEXT_FOUND 0
+#define JANET_PMAP_NEXT_END 1
+#define JANET_PMAP_NEXT_MISSING 2
+
+/* Find the key after key in iteration order: inline pairs first, then the
+ * sub nodes in bitmap order. */
+static int pmnode_next(JanetPMapNode *node, int32_t shift, uint32_t hash, Janet key, Janet *out) {
+    if (shift > JANET_PMAP_MAXSHIFT) {
+        for (int32_t i = 0; i < node->length; i += 2) {
+            if (janet_equals(node->slots[i], key)) {
+                if (i + 2 >= node->length) return JANET_PMAP_NEXT_END;
+                *out = node->slots[i + 2];
+                return JANET_PMAP_NEXT_FOUND;
+            }
+        }
+        return JANET_PMAP_NEXT_MISSING;
+    }
+    uint32_t bit = pm_bit(hash, shift);
+    int32_t ndata = janet_popcount32(node->datamap);
+    int32_t j;
+    if (node->datamap & bit) {
+        int32_t i = 2 * pm_index(node->datamap, bit);
+        if (!janet_equals(node->slots[i], key)) return JANET_PMAP_NEXT_MISSING;
+        if (i + 2 < 2 * ndata) {
+            *out = node->slots[i + 2];
+            return JANET_PMAP_NEXT_FOUND;
+        }
+        j = 0;
+    } else if (node->nodemap & bit) {
+        j = pm_index(node->nodemap, bit);
+        int status = pmnode_next(pmnode_child(node, 2 * ndata + j), shift + JANET_PBITS, hash, key, out);
+        if (status != JANET_PMAP_NEXT_END) return status;
+        j++;
+    } else {
+        return JANET_PMAP_NEXT_MISSING;
+    }
+    if (2 * ndata + j >= node->length) return JANET_PMAP_NEXT_END;
+    *out = pmnode_first(pmnode_child(node, 2 * ndata + j), shift + JANET_PBITS);
+    return JANET_PMAP_NEXT_FOUND;
+}
+
+/* Call visit on every pair until it returns non-zero */
+typedef int (*JanetPMapVisitor)(void *ctx, Janet key, Janet value);
+
+static int pmnode_visit(JanetPMapNode *node, int32_t shift, JanetPMapVisitor visit, void *ctx) {
+    int32_t npairs = pmnode_pairs(node, shift);
+    for (int32_t i = 0; i < npairs; i++) {
+        if (visit(ctx, node->slots[2 * i], node->slots[2 * i + 1])) return 1;
+    }
+    for (int32_t i = 2 * npairs; i < node->length; i++) {
+        if (pmnode_visit(pmnode_child(node, i), shift + JANET_PBITS, visit, ctx)) return 1;
+    }
+    return 0;
+}
+
+static void pmap_put(JanetPMap *m, uint64_t edit, Janet key, Janet value);
+
+static void pmap_remove(JanetPMap *m, uint64_t edit, Janet key) {
+    int removed = 0;
+    JanetPMapNode *root = pmap_dissoc(m->root, edit, 0, (uint32_t) janet_hash(key), key, &removed);
+    if (!removed) return;
+    m->root = root;
+    m->count--;
+    m->hash = 0;
+}
+
+/* Like tables, nil and NaN keys are ignored and nil values remove keys */
+static void pmap_put(JanetPMap *m, uint64_t edit, Janet key, Janet value) {
+    if (janet_checktype(key, JANET_NIL)) return;
+    if (janet_checktype(key, JANET_NUMBER) && isnan(janet_unwrap_number(key))) return;
+    if (janet_checktype(value, JANET_NIL)) {
+        pmap_remove(m, edit, key);
+        return;
+    }
+    int added = 0;
+    JanetPMapNode *root = pmap_assoc(m->root, edit, 0, (uint32_t) janet_hash(key), key, value, &added);
+    if (added && m->count == INT32_MAX) janet_panic("map overflow");
+    m->root = root;
+    m->count += added;
+    m->hash = 0;
+}
+
+/*
+ * Abstract types
+ */
+
+static int pvec_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetPVec *v = (JanetPVec *) p;
+    janet_mark(janet_wrap_abstract(v->root));
+    janet_mark(janet_wrap_abstract(v->tail));
+    return 0;
+}
+
+static int pvec_get(void *p, Janet key, Janet *out) {
+    JanetPVec *v = (JanetPVec *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= v->count) return 0;
+    *out = pvec_ref(v, i);
+    return 1;
+}
+
+static Janet pvec_next(void *p, Janet key) {
+    JanetPVec *v = (JanetPVec *) p;
+    if (janet_checktype(key, JANET_NIL)) {
+        return v->count ? janet_wrap_integer(0) : janet_wrap_nil();
+    }
+    if (!janet_checkint(key)) return janet_wrap_nil();
+    int32_t i = janet_unwrap_integer(key);
+    return (i >= 0 && i + 1 < v->count) ? janet_wrap_integer(i + 1) : janet_wrap_nil();
+}
+
+static int32_t pvec_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetPVec *) p)->count;
+}
+
+static void pvec_tostring(void *p, JanetBuffer *buffer) {
+    JanetPVec *v = (JanetPVec *) p;
+    janet_buffer_push_u8(buffer, '[');
+    for (int32_t i = 0; i < v->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, pvec_ref(v, i));
+    }
+    janet_buffer_push_u8(buffer, ']');
+}
+
+/* Same mixing as tuples */
+static int32_t pvec_hash(void *p, size_t size) {
+    (void) size;
+    JanetPVec *v = (JanetPVec *) p;
+    if (!v->hash) {
+        uint32_t hash = 0;
+        for (int32_t i = 0; i < v->count; i += JANET_PWIDTH) {
+            JanetPVecNode *leaf = pvec_leaf(v, i);
+            int32_t n = v->count - i < JANET_PWIDTH ? v->count - i : JANET_PWIDTH;
+            for (int32_t j = 0; j < n; j++) {
+                uint32_t elem = janet_hash(leaf->slots[j]);
+                hash ^= elem + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+        }
+        v->hash = hash ? (int32_t) hash : 1;
+    }
+    return v->hash;
+}
+
+/* Vectors order like tuples, element by element */
+static int pvec_compare(void *lhs, void *rhs) {
+    JanetPVec *a = (JanetPVec *) lhs;
+    JanetPVec *b = (JanetPVec *) rhs;
+    int32_t n = a->count < b->count ? a->count : b->count;
+    for (int32_t i = 0; i < n; i += JANET_PWIDTH) {
+        JanetPVecNode *la = pvec_leaf(a, i);
+        JanetPVecNode *lb = pvec_leaf(b, i);
+        if (la == lb) continue;
+        int32_t m = n - i < JANET_PWIDTH ? n - i : JANET_PWIDTH;
+        for (int32_t j = 0; j < m; j++) {
+            int diff = janet_compare(la->slots[j], lb->slots[j]);
+            if (diff) return diff;
+        }
+    }
+    return a->count == b->count ? 0 : a->count < b->count ? -1 : 1;
+}
+
+static void pvec_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetPVec *v = (JanetPVec *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, v->count);
+    for (int32_t i = 0; i < v->count; i++) {
+        janet_marshal_janet(ctx, pvec_ref(v, i));
+    }
+}
+
+static void pvec_init(JanetPVec *v) {
+    v->count = 0;
+    v->shift = JANET_PBITS;
+    v->hash = 0;
+    v->edit = 0;
+    v->root = pvnode_new(0);
+    v->tail = pvnode_new(0);
+}
+
+static void *pvec_unmarshal(JanetMarshalContext *ctx) {
+    JanetPVec *v = janet_unmarshal_abstract(ctx, sizeof(JanetPVec));
+    pvec_init(v);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid vector length");
+    uint64_t edit = janet_pedit_new();
+    for (int32_t i = 0; i < count; i++) {
+        pvec_push(v, edit, janet_unmarshal_janet(ctx));
+    }
+    return v;
+}
+
+static void pvec_transient_put(void *p, Janet key, Janet value);
+
+static const JanetAbstractType janet_pvec_type = {
+    "core/pvec",
+    NULL,
+    pvec_gcmark,
+    pvec_get,
+    NULL,
+    pvec_marshal,
+    pvec_unmarshal,
+    pvec_tostring,
+    pvec_compare,
+    pvec_hash,
+    pvec_next,
+    NULL,
+    pvec_length,
+    JANET_ATEND_LENGTH
+};
+
+static const JanetAbstractType janet_pvec_transient_type = {
+    "core/pvec-transient",
+    NULL,
+    pvec_gcmark,
+    pvec_get,
+    pvec_transient_put,
+    NULL,
+    NULL,
+    pvec_tostring,
+    NULL,
+    NULL,
+    pvec_next,
+    NULL,
+    pvec_length,
+    JANET_ATEND_LENGTH
+};
+
+static int pmap_gcmark(void *p, size_t size) {
+    (void) size;
+    janet_mark(janet_wrap_abstract(((JanetPMap *) p)->root));
+    return 0;
+}
+
+static int pmap_get(void *p, Janet key, Janet *out) {
+    JanetPMap *m = (JanetPMap *) p;
+    const Janet *kv = pmap_find(m->root, (uint32_t) janet_hash(key), key);
+    if (kv == NULL) return 0;
+    *out = kv[1];
+    return 1;
+}
+
+static Janet pmap_next(void *p, Janet key) {
+    JanetPMap *m = (JanetPMap *) p;
+    if (m->count == 0) return janet_wrap_nil();
+    if (janet_checktype(key, JANET_NIL)) return pmnode_first(m->root, 0);
+    Janet out;
+    if (pmnode_next(m->root, 0, (uint32_t) janet_hash(key), key, &out) != JANET_PMAP_NEXT_FOUND) {
+        return janet_wrap_nil();
+    }
+    return out;
+}
+
+static int32_t pmap_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetPMap *) p)->count;
+}
+
+typedef struct {
+    JanetBuffer *buffer;
+    int first;
+} JanetPMapPrinter;
+
+static int pmap_visit_tostring(void *ctx, Janet key, Janet value) {
+    JanetPMapPrinter *printer = (JanetPMapPrinter *) ctx;
+    if (!printer->first) janet_buffer_push_u8(printer->buffer, ' ');
+    printer->first = 0;
+    janet_pretty(printer->buffer, 4, JANET_PRETTY_ONELINE, key);
+    janet_buffer_push_u8(printer->buffer, ' ');
+    janet_pretty(printer->buffer, 4, JANET_PRETTY_ONELINE, value);
+    return 0;
+}
+
+static void pmap_tostring(void *p, JanetBuffer *buffer) {
+    JanetPMapPrinter printer = {buffer, 1};
+    janet_buffer_push_u8(buffer, '{');
+    pmnode_visit(((JanetPMap *) p)->root, 0, pmap_visit_tostring, &printer);
+    janet_buffer_push_u8(buffer, '}');
+}
+
+/* Entries combine by addition so the hash does not depend on layout */
+static int pmap_visit_hash(void *ctx, Janet key, Janet value) {
+    uint32_t kh = (uint32_t) janet_hash(key);
+    uint32_t vh = (uint32_t) janet_hash(value);
+    *((uint32_t *) ctx) += kh ^ (vh + 0x9e3779b9 + (kh << 6) + (kh >> 2));
+    return 0;
+}
+
+static int32_t pmap_hash(void *p, size_t size) {
+    (void) size;
+    JanetPMap *m = (JanetPMap *) p;
+    if (!m->hash) {
+        uint32_t hash = 0;
+        pmnode_visit(m->root, 0, pmap_visit_hash, &hash);
+        m->hash = hash ? (int32_t) hash : 1;
+    }
+    return m->hash;
+}
+
+static int pmap_visit_missing(void *ctx, Janet key, Janet value) {
+    const Janet *kv = pmap_find(((JanetPMap *) ctx)->root, (uint32_t) janet_hash(key), key);
+    return kv == NULL || !janet_equals(kv[1], value);
+}
+
+/* Maps order by size and hash first, like structs. Unequal maps that agree on
+ * both fall back to identity. */
+static int pmap_compare(void *lhs, void *rhs) {
+    JanetPMap *a = (JanetPMap *) lhs;
+    JanetPMap *b = (JanetPMap *) rhs;
+    if (a->count != b->count) return a->count < b->count ? -1 : 1;
+    int32_t ha = pmap_hash(a, 0);
+    int32_t hb = pmap_hash(b, 0);
+    if (ha != hb) return ha < hb ? -1 : 1;
+    if (a->root == b->root || !pmnode_visit(a->root, 0, pmap_visit_missing, b)) return 0;
+    return a > b ? 1 : -1;
+}
+
+static int pmap_visit_marshal(void *ctx, Janet key, Janet value) {
+    janet_marshal_janet((JanetMarshalContext *) ctx, key);
+    janet_marshal_janet((JanetMarshalContext *) ctx, value);
+    return 0;
+}
+
+static void pmap_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetPMap *m = (JanetPMap *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, m->count);
+    pmnode_visit(m->root, 0, pmap_visit_marshal, ctx);
+}
+
+static void pmap_init(JanetPMap *m) {
+    m->count = 0;
+    m->hash = 0;
+    m->edit = 0;
+    m->root = pmnode_new(0, 0, 0, 0);
+}
+
+static void *pmap_unmarshal(JanetMarshalContext *ctx) {
+    JanetPMap *m = janet_unmarshal_abstract(ctx, sizeof(JanetPMap));
+    pmap_init(m);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid map size");
+    uint64_t edit = janet_pedit_new();
+    for (int32_t i = 0; i < count; i++) {
+        Janet key = janet_unmarshal_janet(ctx);
+        Janet value = janet_unmarshal_janet(ctx);
+        pmap_put(m, edit, key, value);
+    }
+    return m;
+}
+
+static void pmap_transient_put(void *p, Janet key, Janet value);
+
+static const JanetAbstractType janet_pmap_type = {
+    "core/pmap",
+    NULL,
+    pmap_gcmark,
+    pmap_get,
+    NULL,
+    pmap_marshal,
+    pmap_unmarshal,
+    pmap_tostring,
+    pmap_compare,
+    pmap_hash,
+    pmap_next,
+    NULL,
+    pmap_length,
+    JANET_ATEND_LENGTH
+};
+
+static const JanetAbstractType janet_pmap_transient_type = {
+    "core/pmap-transient",
+    NULL,
+    pmap_gcmark,
+    pmap_get,
+    pmap_transient_put,
+    NULL,
+    NULL,
+    pmap_tostring,
+    NULL,
+    NULL,
+    pmap_next,
+    NULL,
+    pmap_length,
+    JANET_ATEND_LENGTH
+};
+
+static void pvec_check_index(JanetPVec *v, Janet key) {
+    if (!janet_checkint(key)) janet_panicf("expected integer key, got %v", key);
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i > v->count) janet_panicf("index %d out of range [0,%d]", i, v->count);
+}
+
+static void janet_check_transient(uint64_t edit) {
+    if (!edit) janet_panic("transient used after being made persistent");
+}
+
+static void pvec_transient_put(void *p, Janet key, Janet value) {
+    JanetPVec *v = (JanetPVec *) p;
+    janet_check_transient(v->edit);
+    pvec_check_index(v, key);
+    pvec_assoc(v, v->edit, janet_unwrap_integer(key), value);
+}
+
+static void pmap_transient_put(void *p, Janet key, Janet value) {
+    JanetPMap *m = (JanetPMap *) p;
+    janet_check_transient(m->edit);
+    pmap_put(m, m->edit, key, value);
+}
+
+static JanetPVec *pvec_copy(JanetPVec *v, const JanetAbstractType *at, uint64_t edit) {
+    JanetPVec *copy = janet_abstract(at, sizeof(JanetPVec));
+    *copy = *v;
+    copy->edit = edit;
+    return copy;
+}
+
+static JanetPMap *pmap_copy(JanetPMap *m, const JanetAbstractType *at, uint64_t edit) {
+    JanetPMap *copy = janet_abstract(at, sizeof(JanetPMap));
+    *copy = *m;
+    copy->edit = edit;
+    return copy;
+}
+
+/* Get the vector to update for argument n. Transients are updated in place;
+ * persistent vectors are copied first and updated with edit id 0. */
+static JanetPVec *pvec_getupdate(const Janet *argv, int32_t n) {
+    JanetPVec *v = janet_checkabstract(argv[n], &janet_pvec_transient_type);
+    if (v != NULL) {
+        janet_check_transient(v->edit);
+        return v;
+    }
+    return pvec_copy(janet_getabstract(argv, n, &janet_pvec_type), &janet_pvec_type, 0);
+}
+
+static JanetPMap *pmap_getupdate(const Janet *argv, int32_t n) {
+    JanetPMap *m = janet_checkabstract(argv[n], &janet_pmap_transient_type);
+    if (m != NULL) {
+        janet_check_transient(m->edit);
+        return m;
+    }
+    return pmap_copy(janet_getabstract(argv, n, &janet_pmap_type), &janet_pmap_type, 0);
+}
+
+JANET_CORE_FN(cfun_pvec_new,
+              "(pvec/new & xs)",
+              "Create a persistent vector of xs. Persistent vectors are immutable and "
+              "updates return new vectors that share structure with the old one, so "
+              "pushing, setting and popping take O(log32 n) time and space. Index "
+              "them with get and in, and iterate them like tuples.") {
+    JanetPVec *v = janet_abstract(&janet_pvec_type, sizeof(JanetPVec));
+    pvec_init(v);
+    uint64_t edit = janet_pedit_new();
+    for (int32_t i = 0; i < argc; i++) {
+        pvec_push(v, edit, argv[i]);
+    }
+    return janet_wrap_abstract(v);
+}
+
+JANET_CORE_FN(cfun_pvec_push,
+              "(pvec/push v & xs)",
+              "Append xs to the end of vector v. Returns a new vector, or v itself "
+              "if v is a transient.") {
+    janet_arity(argc, 1, -1);
+    JanetPVec *v = pvec_getupdate(argv, 0);
+    for (int32_t i = 1; i < argc; i++) {
+        pvec_push(v, v->edit, argv[i]);
+    }
+    return janet_wrap_abstract(v);
+}
+
+JANET_CORE_FN(cfun_pvec_put,
+              "(pvec/put v i x)",
+              "Set index i of vector v to x. i may be the length of v to append x. "
+              "Returns a new vector, or v itself if v is a transient.") {
+    janet_fixarity(argc, 3);
+    JanetPVec *v = pvec_getupdate(argv, 0);
+    pvec_check_index(v, argv[1]);
+    pvec_assoc(v, v->edit, janet_unwrap_integer(argv[1]), argv[2]);
+    return janet_wrap_abstract(v);
+}
+
+JANET_CORE_FN(cfun_pvec_pop,
+              "(pvec/pop v)",
+              "Remove the last element of vector v. Returns a new vector, or v itself "
+              "if v is a transient. Popping an empty vector returns it unchanged.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *v = pvec_getupdate(argv, 0);
+    if (v->count) pvec_pop(v, v->edit);
+    return janet_wrap_abstract(v);
+}
+
+JANET_CORE_FN(cfun_pvec_transient,
+              "(pvec/transient v)",
+              "Get a transient copy of persistent vector v. A transient is a mutable "
+              "builder that changes its own nodes in place rather than copying them; it "
+              "works with put and the other pvec functions. v itself is not changed.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *v = janet_getabstract(argv, 0, &janet_pvec_type);
+    return janet_wrap_abstract(pvec_copy(v, &janet_pvec_transient_type, janet_pedit_new()));
+}
+
+JANET_CORE_FN(cfun_pvec_persistent,
+              "(pvec/persistent t)",
+              "Get a persistent vector from transient t in O(1) time. t can no longer be "
+              "used afterwards.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *t = janet_getabstract(argv, 0, &janet_pvec_transient_type);
+    janet_check_transient(t->edit);
+    JanetPVec *v = pvec_copy(t, &janet_pvec_type, 0);
+    t->edit = 0;
+    return janet_wrap_abstract(v);
+}
+
+JANET_CORE_FN(cfun_pmap_new,
+              "(pmap/new & kvs)",
+              "Create a persistent hash map from key value pairs. Persistent maps are "
+              "immutable and updates return new maps that share structure with the old "
+              "one, so putting and removing take O(log32 n) time and space. Look keys up "
+              "with get and in, and iterate them like structs. As with tables, nil values "
+              "and nil or NaN keys are ignored.") {
+    if (argc & 1) janet_panic("expected even number of arguments");
+    JanetPMap *m = janet_abstract(&janet_pmap_type, sizeof(JanetPMap));
+    pmap_init(m);
+    uint64_t edit = janet_pedit_new();
+    for (int32_t i = 0; i < argc; i += 2) {
+        pmap_put(m, edit, argv[i], argv[i + 1]);
+    }
+    return janet_wrap_abstract(m);
+}
+
+JANET_CORE_FN(cfun_pmap_put,
+              "(pmap/put m & kvs)",
+              "Associate keys with values in map m. A nil value removes its key. Returns "
+              "a new map, or m itself if m is a transient.") {
+    janet_arity(argc, 1, -1);
+    if (!(argc & 1)) janet_panic("expected even number of key value arguments");
+    JanetPMap *m = pmap_getupdate(argv, 0);
+    for (int32_t i = 1; i < argc; i += 2) {
+        pmap_put(m, m->edit, argv[i], argv[i + 1]);
+    }
+    return janet_wrap_abstract(m);
+}
+
+JANET_CORE_FN(cfun_pmap_remove,
+              "(pmap/remove m & ks)",
+              "Remove keys from map m. Returns a new map, or m itself if m is a "
+              "transient.") {
+    janet_arity(argc, 1, -1);
+    JanetPMap *m = pmap_getupdate(argv, 0);
+    for (int32_t i = 1; i < argc; i++) {
+        pmap_remove(m, m->edit, argv[i]);
+    }
+    return janet_wrap_abstract(m);
+}
+
+JANET_CORE_FN(cfun_pmap_transient,
+              "(pmap/transient m)",
+              "Get a transient copy of persistent map m. A transient is a mutable "
+              "builder that changes its own nodes in place rather than copying them; it "
+              "works with put and the other pmap functions. m itself is not changed.") {
+    janet_fixarity(argc, 1);
+    JanetPMap *m = janet_getabstract(argv, 0, &janet_pmap_type);
+    return janet_wrap_abstract(pmap_copy(m, &janet_pmap_transient_type, janet_pedit_new()));
+}
+
+JANET_CORE_FN(cfun_pmap_persistent,
+              "(pmap/persistent t)",
+              "Get a persistent map from transient t in O(1) time. t can no longer be "
+              "used afterwards.") {
+    janet_fixarity(argc, 1);
+    JanetPMap *t = janet_getabstract(argv, 0, &janet_pmap_transient_type);
+    janet_check_transient(t->edit);
+    JanetPMap *m = pmap_copy(t, &janet_pmap_type, 0);
+    t->edit = 0;
+    return janet_wrap_abstract(m);
+}
+
+/* Module entry point */
+void janet_lib_persistent(JanetTable *env) {
+    JanetRegExt persistent_cfuns[] = {
+        JANET_CORE_REG("pvec/new", cfun_pvec_new),
+        JANET_CORE_REG("pvec/push", cfun_pvec_push),
+        JANET_CORE_REG("pvec/put", cfun_pvec_put),
+        JANET_CORE_REG("pvec/pop", cfun_pvec_pop),
+        JANET_CORE_REG("pvec/transient", cfun_pvec_transient),
+        JANET_CORE_REG("pvec/persistent", cfun_pvec_persistent),
+        JANET_CORE_REG("pmap/new", cfun_pmap_new),
+        JANET_CORE_REG("pmap/put", cfun_pmap_put),
+        JANET_CORE_REG("pmap/remove", cfun_pmap_remove),
+        JANET_CORE_REG("pmap/transient", cfun_pmap_transient),
+        JANET_CORE_REG("pmap/persistent", cfun_pmap_persistent),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, persistent_cfuns);
+    janet_register_abstract_type(&janet_pvec_type);
+    janet_register_abstract_type(&janet_pmap_type);
+}
@@ -923,6 +923,110 @@ JanetBuffer *janet_formatb(JanetBuffer *buffer, const char *format, ...) {
     return buffer;
 }
 
+/* Format a single item for string/format and buffer/format */
+static void janet_format_item(
+    JanetBuffer *b,
+    char conv,
+    const char *form,
+    const char *precision,
+    Janet *argv,
+    int32_t arg,
+    int32_t startlen) {
+    char item[MAX_ITEM];
+    int nb = 0; /* number of bytes in added item */
+    switch (conv) {
+        case 'c': {
+            nb = snprintf(item, MAX_ITEM, form, (int)
+                          janet_getinteger(argv, arg));
+            break;
+        }
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'x':
+        case 'X': {
+            int32_t n = janet_getinteger(argv, arg);
+            nb = snprintf(item, MAX_ITEM, form, n);
+            break;
+        }
+        case 'a':
+        case 'A':
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'g':
+        case 'G': {
+            double d = janet_getnumber(argv, arg);
+            nb = snprintf(item, MAX_ITEM, form, d);
+            break;
+        }
+        case 's': {
+            const uint8_t *s = janet_getstring(argv, arg);
+            int32_t l = janet_string_length(s);
+            if (form[2] == '\0')
+                janet_buffer_push_bytes(b, s, l);
+            else {
+                if (l != (int32_t) strlen((const char *) s))
+                    janet_panic("string contains zeros");
+                if (!strchr(form, '.') && l >= 100) {
+                    janet_panic("no precision and string is too long to be formatted");
+                } else {
+                    nb = snprintf(item, MAX_ITEM, form, s);
+                }
+            }
+            break;
+        }
+        case 'V': {
+            janet_to_string_b(b, argv[arg]);
+            break;
+        }
+        case 'v': {
+            janet_description_b(b, argv[arg]);
+            break;
+        }
+        case 't':
+            janet_buffer_push_cstring(b, typestr(argv[arg]));
+            break;
+        case 'M':
+        case 'm':
+        case 'N':
+        case 'n':
+        case 'Q':
+        case 'q':
+        case 'P':
+        case 'p': { /* janet pretty , precision = depth */
+            int depth = atoi(precision);
+            if (depth < 1) depth = JANET_RECURSION_GUARD;
+            char d = conv;
+            int has_color = (d == 'P') || (d == 'Q') || (d == 'M') || (d == 'N');
+            int has_oneline = (d == 'Q') || (d == 'q') || (d == 'N') || (d == 'n');
+            int has_notrunc = (d == 'M') || (d == 'm') || (d == 'N') || (d == 'n');
+            int flags = 0;
+            flags |= has_color ? JANET_PRETTY_COLOR : 0;
+            flags |= has_oneline ? JANET_PRETTY_ONELINE : 0;
+            flags |= has_notrunc ? JANET_PRETTY_NOTRUNC : 0;
+            janet_pretty_(b, depth, flags, argv[arg], startlen);
+            break;
+        }
+        case 'j': {
+            int depth = atoi(precision);
+            if (depth < 1)
+                depth = JANET_RECURSION_GUARD;
+            janet_jdn_(b, depth, argv[arg], startlen);
+            break;
+        }
+        default: {
+            /* also treat cases 'nLlh' */
+            janet_panicf("invalid conversion '%s' to 'format'",
+                         form);
+        }
+    }
+    if (nb >= MAX_ITEM)
+        janet_panic("format buffer overflow");
+    if (nb > 0)
+        janet_buffer_push_bytes(b, (uint8_t *) item, nb);
+}
+
 /* Shared implementation between string/format and
  * buffer/format */
 void janet_buffer_format(
@@ -941,105 +1045,166 @@ void janet_buffer_format(
         else if (*++strfrmt == '%')
             janet_buffer_push_u8(b, (uint8_t) * strfrmt++); /* %% */
         else { /* format item */
-            char form[MAX_FORMAT], item[MAX_ITEM];
+            char form[MAX_FORMAT];
             char width[3], precision[3];
-            int nb = 0; /* number of bytes in added item */
             if (++arg >= argc)
                 janet_panic("not enough values for format");
             strfrmt = scanformat(strfrmt, form, width, precision);
-            switch (*strfrmt++) {
-                case 'c': {
-                    nb = snprintf(item, MAX_ITEM, form, (int)
-                                  janet_getinteger(argv, arg));
-                    break;
-                }
-                case 'd':
-                case 'i':
-                case 'o':
-                case 'x':
-                case 'X': {
-                    int32_t n = janet_getinteger(argv, arg);
-                    nb = snprintf(item, MAX_ITEM, form, n);
-                    break;
-                }
-                case 'a':
-                case 'A':
-                case 'e':
-                case 'E':
-                case 'f':
-                case 'g':
-                case 'G': {
-                    double d = janet_getnumber(argv, arg);
-                    nb = snprintf(item, MAX_ITEM, form, d);
-                    break;
-                }
-                case 's': {
-                    const uint8_t *s = janet_getstring(argv, arg);
-                    int32_t l = janet_string_length(s);
-                    if (form[2] == '\0')
-                        janet_buffer_push_bytes(b, s, l);
-                    else {
-                        if (l != (int32_t) strlen((const char *) s))
-                            janet_panic("string contains zeros");
-                        if (!strchr(form, '.') && l >= 100) {
-                            janet_panic("no precision and string is too long to be formatted");
-                        } else {
-                            nb = snprintf(item, MAX_ITEM, form, s);
-                        }
-                    }
-                    break;
-                }
-                case 'V': {
-                    janet_to_string_b(b, argv[arg]);
-                    break;
-                }
-                case 'v': {
-                    janet_description_b(b, argv[arg]);
-                    break;
-                }
-                case 't':
-                    janet_buffer_push_cstring(b, typestr(argv[arg]));
-                    break;
-                case 'M':
-                case 'm':
-                case 'N':
-                case 'n':
-                case 'Q':
-                case 'q':
-                case 'P':
-                case 'p': { /* janet pretty , precision = depth */
-                    int depth = atoi(precision);
-                    if (depth < 1) depth = JANET_RECURSION_GUARD;
-                    char d = strfrmt[-1];
-                    int has_color = (d == 'P') || (d == 'Q') || (d == 'M') || (d == 'N');
-                    int has_oneline = (d == 'Q') || (d == 'q') || (d == 'N') || (d == 'n');
-                    int has_notrunc = (d == 'M') || (d == 'm') || (d == 'N') || (d == 'n');
-                    int flags = 0;
-                    flags |= has_color ? JANET_PRETTY_COLOR : 0;
-                    flags |= has_oneline ? JANET_PRETTY_ONELINE : 0;
-                    flags |= has_notrunc ? JANET_PRETTY_NOTRUNC : 0;
-                    janet_pretty_(b, depth, flags, argv[arg], startlen);
-                    break;
-                }
-                case 'j': {
-                    int depth = atoi(precision);
-                    if (depth < 1)
-                        depth = JANET_RECURSION_GUARD;
-                    janet_jdn_(b, depth, argv[arg], startlen);
-                    break;
-                }
-                default: {
-                    /* also treat cases 'nLlh' */
-                    janet_panicf("invalid conversion '%s' to 'format'",
-                                 form);
-                }
+            janet_format_item(b, *strfrmt++, form, precision, argv, arg, startlen);
+        }
+    }
+}
+
+/* Format strings that are constants can be parsed by the compiler ahead of
+ * time. A compiled format is a list of items, each of which pushes some
+ * literal bytes and then formats one value. */
+
+typedef struct {
+    int32_t literal; /* number of literal bytes before this item */
+    char conv; /* conversion, or 0 for trailing literal bytes */
+    char form[MAX_FORMAT];
+    char precision[3];
+} JanetFormatItem;
+
+typedef struct {
+    JanetString source;
+    uint8_t *literals;
+    int32_t count;
+    JanetFormatItem items[];
+} JanetFormat;
+
+static int format_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetFormat *fmt = (JanetFormat *) p;
+    if (fmt->source) janet_mark(janet_wrap_string(fmt->source));
+    return 0;
+}
+
+static void format_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetFormat *fmt = (JanetFormat *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_size(ctx, (size_t) janet_string_length(fmt->source));
+    janet_marshal_bytes(ctx, fmt->source, (size_t) janet_string_length(fmt->source));
+}
+
+static JanetFormat *format_compile(JanetString source);
+
+static void *format_unmarshal(JanetMarshalContext *ctx) {
+    size_t len = janet_unmarshal_size(ctx);
+    janet_unmarshal_ensure(ctx, len);
+    uint8_t *bytes = janet_string_begin((int32_t) len);
+    janet_unmarshal_bytes(ctx, bytes, len);
+    JanetFormat *fmt = format_compile(janet_string_end(bytes));
+    if (NULL == fmt) janet_panic("invalid compiled format");
+    janet_unmarshal_abstract_reuse(ctx, fmt);
+    return fmt;
+}
+
+static void format_tostring(void *p, JanetBuffer *buffer) {
+    JanetFormat *fmt = (JanetFormat *) p;
+    janet_escape_string_b(buffer, fmt->source);
+}
+
+const JanetAbstractType janet_format_type = {
+    "core/format",
+    NULL,
+    format_gcmark,
+    NULL, /* get */
+    NULL, /* put */
+    format_marshal,
+    format_unmarshal,
+    format_tostring,
+    JANET_ATEND_TOSTRING
+};
+
+/* Compile a format string, or return NULL if the format is not valid. */
+static JanetFormat *format_compile(JanetString source) {
+    const char *strfrmt = (const char *) source;
+    const char *strfrmt_end = strfrmt + strlen(strfrmt);
+    int32_t count = 1;
+    for (const char *c = strfrmt; c < strfrmt_end; c++) {
+        if (*c == '%') count++;
+    }
+    size_t items_size = sizeof(JanetFormat) + sizeof(JanetFormatItem) * (size_t) count;
+    JanetFormat *fmt = janet_abstract(&janet_format_type, items_size + (strfrmt_end - strfrmt));
+    fmt->source = source;
+    fmt->literals = (uint8_t *) fmt + items_size;
+    fmt->count = 0;
+    int32_t nliterals = 0;
+    int32_t literal = 0;
+    while (strfrmt < strfrmt_end) {
+        if (*strfrmt != '%') {
+            fmt->literals[nliterals++] = (uint8_t) * strfrmt++;
+            literal++;
+        } else if (*++strfrmt == '%') {
+            fmt->literals[nliterals++] = (uint8_t) * strfrmt++;
+            literal++;
+        } else {
+            JanetFormatItem *item = fmt->items + fmt->count++;
+            char width[3];
+            const char *p = strfrmt;
+            /* Leave formats that scanformat would reject to the runtime */
+            while (*p != '\0' && strchr(FMT_FLAGS, *p) != NULL) p++;
+            if ((size_t)(p - strfrmt) >= sizeof(FMT_FLAGS) / sizeof(char)) return NULL;
+            if (isdigit((int)(*p))) p++;
+            if (isdigit((int)(*p))) p++;
+            if (*p == '.') {
+                p++;
+                if (isdigit((int)(*p))) p++;
+                if (isdigit((int)(*p))) p++;
             }
-            if (nb >= MAX_ITEM)
-                janet_panic("format buffer overflow");
-            if (nb > 0)
-                janet_buffer_push_bytes(b, (uint8_t *) item, nb);
+            if (isdigit((int)(*p))) return NULL;
+            if (*p == '\0') return NULL;
+            strfrmt = scanformat(strfrmt, item->form, width, item->precision);
+            item->conv = *strfrmt++;
+            item->literal = literal;
+            literal = 0;
         }
     }
+    JanetFormatItem *last = fmt->items + fmt->count++;
+    last->conv = 0;
+    last->literal = literal;
+    return fmt;
+}
+
+Janet janet_format_compile(JanetString source) {
+    if (strlen((const char *) source) != (size_t) janet_string_length(source)) {
+        return janet_wrap_nil();
+    }
+    JanetFormat *fmt = format_compile(source);
+    return fmt ? janet_wrap_abstract(fmt) : janet_wrap_nil();
+}
+
+/* Get the format argument for string/format and similar functions. This is
+ * either a string, or a format compiled by the compiler for a constant string. */
+Janet janet_getformat(const Janet *argv, int32_t n) {
+    if (janet_checkabstract(argv[n], &janet_format_type)) return argv[n];
+    return janet_wrap_string(janet_getstring(argv, n));
+}
+
+void janet_buffer_format_value(
+    JanetBuffer *b,
+    Janet format,
+    int32_t argstart,
+    int32_t argc,
+    Janet *argv) {
+    if (!janet_checktype(format, JANET_ABSTRACT)) {
+        janet_buffer_format(b, (const char *) janet_unwrap_string(format), argstart, argc, argv);
+        return;
+    }
+    JanetFormat *fmt = (JanetFormat *) janet_unwrap_abstract(format);
+    const uint8_t *literals = fmt->literals;
+    int32_t arg = argstart;
+    int32_t startlen = b->count;
+    for (int32_t i = 0; i < fmt->count; i++) {
+        JanetFormatItem *item = fmt->items + i;
+        janet_buffer_push_bytes(b, literals, item->literal);
+        literals += item->literal;
+        if (!item->conv) break;
+        if (++arg >= argc)
+            janet_panic("not enough values for format");
+        janet_format_item(b, item->conv, item->form, item->precision, argv, arg, startlen);
+    }
 }
 
 #undef HEX
@@ -0,0 +1,235 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include <math.h>
+#include "util.h"
+#endif
+
+/*
+ * Lazy numeric ranges. A range is just a start, a step and a count, and
+ * element i is start + i * step. range builds an array of the same elements,
+ * and each and loop step through a call to range lazily.
+ */
+
+typedef struct {
+    double start;
+    double step;
+    int32_t count;
+} JanetNumRange;
+
+static double range_at(const JanetNumRange *r, int32_t i) {
+    return r->start + (double) i * r->step;
+}
+
+/* Parse the arguments of range. Empty ranges and ranges with one element
+ * are normalized so that equal ranges have equal fields. */
+static JanetNumRange range_parse(int32_t argc, Janet *argv) {
+    JanetNumRange r;
+    r.start = 0;
+    r.step = 1;
+    switch (argc) {
+        default:
+            janet_panic("expected 1 to 3 arguments to range");
+        case 1:
+            r.count = janet_getinteger(argv, 0);
+            break;
+        case 2: {
+            r.start = janet_getnumber(argv, 0);
+            Janet len = janet_wrap_number(janet_getnumber(argv, 1) - r.start);
+            if (!janet_checkint(len)) janet_panicf("bad slot #0, expected 32 bit signed integer, got %v", len);
+            r.count = janet_unwrap_integer(len);
+            break;
+        }
+        case 3: {
+            r.start = janet_getnumber(argv, 0);
+            double end = janet_getnumber(argv, 1);
+            r.step = janet_getnumber(argv, 2);
+            double n = (r.step == 0) ? 0 : ceil((end - r.start) / r.step);
+            if (isnan(n)) n = 0;
+            if (!(n < INT32_MAX)) janet_panicf("range %v %v %v has too many elements", argv[0], argv[1], argv[2]);
+            r.count = n > 0 ? (int32_t) n : 0;
+            /* Division can round across the end */
+            if (r.step > 0) {
+                while (r.count > 0 && !(range_at(&r, r.count - 1) < end)) r.count--;
+                while (r.count < INT32_MAX && range_at(&r, r.count) < end) r.count++;
+            } else if (r.step < 0) {
+                while (r.count > 0 && !(range_at(&r, r.count - 1) > end)) r.count--;
+                while (r.count < INT32_MAX && range_at(&r, r.count) > end) r.count++;
+            }
+            break;
+        }
+    }
+    if (r.count <= 0) {
+        r.count = 0;
+        r.start = 0;
+    }
+    if (r.count <= 1) r.step = 1;
+    return r;
+}
+
+static int range_get(void *p, Janet key, Janet *out) {
+    JanetNumRange *r = (JanetNumRange *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= r->count) return 0;
+    *out = janet_wrap_number(range_at(r, i));
+    return 1;
+}
+
+Janet janet_range_next(void *p, Janet key) {
+    JanetNumRange *r = (JanetNumRange *) p;
+    int32_t i;
+    if (janet_checktype(key, JANET_NIL)) {
+        i = 0;
+    } else if (janet_checkint(key) && janet_unwrap_integer(key) < INT32_MAX) {
+        i = janet_unwrap_integer(key) + 1;
+    } else {
+        return janet_wrap_nil();
+    }
+    return (i >= 0 && i < r->count) ? janet_wrap_integer(i) : janet_wrap_nil();
+}
+
+static int32_t range_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetNumRange *) p)->count;
+}
+
+static void range_tostring(void *p, JanetBuffer *buffer) {
+    JanetNumRange *r = (JanetNumRange *) p;
+    janet_formatb(buffer, "%v %v %v",
+                  janet_wrap_number(r->start),
+                  janet_wrap_number(range_at(r, r->count)),
+                  janet_wrap_number(r->step));
+}
+
+static int range_compare(void *lhs, void *rhs) {
+    JanetNumRange *a = (JanetNumRange *) lhs;
+    JanetNumRange *b = (JanetNumRange *) rhs;
+    if (a->count != b->count) return a->count < b->count ? -1 : 1;
+    if (a->start != b->start) return a->start < b->start ? -1 : 1;
+    if (a->step != b->step) return a->step < b->step ? -1 : 1;
+    return 0;
+}
+
+static int32_t range_hash(void *p, size_t size) {
+    (void) size;
+    JanetNumRange *r = (JanetNumRange *) p;
+    uint32_t hash = (uint32_t) janet_hash(janet_wrap_number(r->start));
+    hash = hash * 31 + (uint32_t) janet_hash(janet_wrap_number(r->step));
+    return (int32_t)(hash * 31 + (uint32_t) r->count);
+}
+
+static void range_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetNumRange *r = (JanetNumRange *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_janet(ctx, janet_wrap_number(r->start));
+    janet_marshal_janet(ctx, janet_wrap_number(r->step));
+    janet_marshal_int(ctx, r->count);
+}
+
+static void *range_unmarshal(JanetMarshalContext *ctx) {
+    JanetNumRange *r = janet_unmarshal_abstract(ctx, sizeof(JanetNumRange));
+    Janet start = janet_unmarshal_janet(ctx);
+    Janet step = janet_unmarshal_janet(ctx);
+    if (!janet_checktype(start, JANET_NUMBER) || !janet_checktype(step, JANET_NUMBER)) {
+        janet_panic("expected numbers in range");
+    }
+    r->start = janet_unwrap_number(start);
+    r->step = janet_unwrap_number(step);
+    r->count = janet_unmarshal_int(ctx);
+    if (r->count < 0) janet_panic("invalid range count");
+    return r;
+}
+
+const JanetAbstractType janet_range_type = {
+    "core/range",
+    NULL,
+    NULL,
+    range_get,
+    NULL,
+    range_marshal,
+    range_unmarshal,
+    range_tostring,
+    range_compare,
+    range_hash,
+    janet_range_next,
+    NULL,
+    range_length,
+    JANET_ATEND_LENGTH
+};
+
+static Janet range_wrap(JanetNumRange r) {
+    JanetNumRange *p = janet_abstract(&janet_range_type, sizeof(JanetNumRange));
+    *p = r;
+    return janet_wrap_abstract(p);
+}
+
+/* Slice a range without touching its elements. Called by slice. */
+Janet janet_range_slice(int32_t argc, Janet *argv) {
+    JanetNumRange *r = janet_getabstract(argv, 0, &janet_range_type);
+    JanetRange slice = janet_getslice(argc, argv);
+    JanetNumRange ret;
+    ret.start = range_at(r, slice.start);
+    ret.step = r->step;
+    ret.count = slice.end - slice.start;
+    if (ret.count == 0) ret.start = 0;
+    if (ret.count <= 1) ret.step = 1;
+    return range_wrap(ret);
+}
+
+JANET_CORE_FN(cfun_range,
+              "(range & args)",
+              "Create an array of values [start, end) with a given step. "
+              "With one argument returns a range [0, end). With two arguments, returns "
+              "a range [start, end). With three, returns a range with optional step size. "
+              "Element i of the range is start + i * step.") {
+    JanetNumRange r = range_parse(argc, argv);
+    JanetArray *array = janet_array(r.count);
+    for (int32_t i = 0; i < r.count; i++) {
+        array->data[i] = janet_wrap_number(range_at(&r, i));
+    }
+    array->count = r.count;
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_range_new,
+              "(range/new & args)",
+              "Create a lazy range with the same elements as (range ;args), without "
+              "allocating them. Ranges support length, get, next and slice, and each and "
+              "loop step through calls to range this way.") {
+    return range_wrap(range_parse(argc, argv));
+}
+
+/* Module entry point */
+void janet_lib_range(JanetTable *env) {
+    JanetRegExt range_cfuns[] = {
+        JANET_CORE_REG("range", cfun_range),
+        JANET_CORE_REG("range/new", cfun_range_new),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, range_cfuns);
+    janet_register_abstract_type(&janet_range_type);
+}
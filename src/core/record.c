@@ -0,0 +1,394 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+
+/*
+ * Records with shared shapes. A shape is a fixed list of keys, and a record
+ * is a shape plus one value per key. Every record built from a shape shares
+ * its key layout, so a record stores a single Janet per entry where a struct
+ * stores a key value pair in a table at most half full. Getting a key from a
+ * small shape is a scan of a few keys followed by an indexed load.
+ */
+
+/* Shapes with more keys than this look keys up through a struct */
+#define JANET_SHAPE_SCAN_MAX 8
+
+typedef struct {
+    int32_t count;
+    const Janet *keys;
+    const JanetKV *index;
+    int32_t order[]; /* Positions of the keys in janet_compare order */
+} JanetShape;
+
+typedef struct {
+    JanetShape *shape;
+    Janet values[];
+} JanetRecord;
+
+static const JanetAbstractType janet_shape_type;
+static const JanetAbstractType janet_record_type;
+
+/* Position of key in the shape, or -1 if it is missing */
+static int32_t shape_find(const JanetShape *s, Janet key) {
+    if (s->index == NULL) {
+        /* Keys are usually interned keywords, so try identity first */
+        JanetType type = janet_type(key);
+        for (int32_t i = 0; i < s->count; i++) {
+            if (janet_type(s->keys[i]) == type && janet_u64(s->keys[i]) == janet_u64(key)) return i;
+        }
+        for (int32_t i = 0; i < s->count; i++) {
+            if (janet_equals(s->keys[i], key)) return i;
+        }
+        return -1;
+    }
+    Janet pos = janet_struct_get(s->index, key);
+    return janet_checktype(pos, JANET_NIL) ? -1 : (int32_t) janet_unwrap_number(pos);
+}
+
+/* Fill in the index and order of a shape once its keys are set */
+static void shape_finish(JanetShape *s) {
+    s->index = NULL;
+    for (int32_t i = 0; i < s->count; i++) {
+        Janet key = s->keys[i];
+        if (janet_checktype(key, JANET_NIL) ||
+                (janet_checktype(key, JANET_NUMBER) && isnan(janet_unwrap_number(key)))) {
+            janet_panicf("invalid shape key %v", key);
+        }
+    }
+    if (s->count > JANET_SHAPE_SCAN_MAX) {
+        JanetKV *index = janet_struct_begin(s->count);
+        for (int32_t i = 0; i < s->count; i++) {
+            janet_struct_put(index, s->keys[i], janet_wrap_integer(i));
+        }
+        s->index = janet_struct_end(index);
+        if (janet_struct_length(s->index) != s->count) janet_panic("duplicate shape key");
+    } else {
+        for (int32_t i = 0; i < s->count; i++) {
+            for (int32_t j = 0; j < i; j++) {
+                if (janet_equals(s->keys[i], s->keys[j])) {
+                    janet_panicf("duplicate shape key %v", s->keys[i]);
+                }
+            }
+        }
+    }
+    /* Insertion sort, shapes are small */
+    for (int32_t i = 0; i < s->count; i++) {
+        int32_t pos = i;
+        int32_t j = i;
+        while (j > 0 && janet_compare(s->keys[s->order[j - 1]], s->keys[pos]) > 0) {
+            s->order[j] = s->order[j - 1];
+            j--;
+        }
+        s->order[j] = pos;
+    }
+}
+
+static JanetShape *shape_new(const Janet *keys, int32_t count) {
+    JanetShape *s = janet_abstract(&janet_shape_type, sizeof(JanetShape) + (size_t) count * sizeof(int32_t));
+    s->count = count;
+    s->keys = janet_tuple_n(keys, count);
+    s->index = NULL;
+    shape_finish(s);
+    return s;
+}
+
+static int shape_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetShape *s = (JanetShape *) p;
+    if (s->keys == NULL) return 0;
+    janet_mark(janet_wrap_tuple(s->keys));
+    if (s->index != NULL) janet_mark(janet_wrap_struct(s->index));
+    return 0;
+}
+
+static JanetRecord *record_new(JanetShape *s) {
+    JanetRecord *r = janet_abstract(&janet_record_type, sizeof(JanetRecord) + (size_t) s->count * sizeof(Janet));
+    r->shape = s;
+    return r;
+}
+
+/* Calling a shape builds a record from values in key order */
+static Janet shape_call(void *p, int32_t argc, Janet *argv) {
+    JanetShape *s = (JanetShape *) p;
+    janet_fixarity(argc, s->count);
+    JanetRecord *r = record_new(s);
+    safe_memcpy(r->values, argv, (size_t) argc * sizeof(Janet));
+    return janet_wrap_abstract(r);
+}
+
+static int32_t shape_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetShape *) p)->count;
+}
+
+static void shape_tostring(void *p, JanetBuffer *buffer) {
+    JanetShape *s = (JanetShape *) p;
+    for (int32_t i = 0; i < s->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, s->keys[i]);
+    }
+}
+
+static void shape_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetShape *s = (JanetShape *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, s->count);
+    for (int32_t i = 0; i < s->count; i++) {
+        janet_marshal_janet(ctx, s->keys[i]);
+    }
+}
+
+static void *shape_unmarshal(JanetMarshalContext *ctx) {
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid shape size");
+    JanetShape *s = janet_unmarshal_abstract(ctx, sizeof(JanetShape) + (size_t) count * sizeof(int32_t));
+    s->count = 0;
+    s->keys = NULL;
+    s->index = NULL;
+    Janet *keys = janet_tuple_begin(count);
+    for (int32_t i = 0; i < count; i++) {
+        keys[i] = janet_unmarshal_janet(ctx);
+    }
+    s->keys = janet_tuple_end(keys);
+    s->count = count;
+    shape_finish(s);
+    return s;
+}
+
+static const JanetAbstractType janet_shape_type = {
+    "core/shape",
+    NULL,
+    shape_gcmark,
+    NULL,
+    NULL,
+    shape_marshal,
+    shape_unmarshal,
+    shape_tostring,
+    NULL,
+    NULL,
+    NULL,
+    shape_call,
+    shape_length,
+    JANET_ATEND_LENGTH
+};
+
+static int record_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetRecord *r = (JanetRecord *) p;
+    if (r->shape == NULL) return 0;
+    janet_mark(janet_wrap_abstract(r->shape));
+    for (int32_t i = 0; i < r->shape->count; i++) {
+        janet_mark(r->values[i]);
+    }
+    return 0;
+}
+
+static int record_get(void *p, Janet key, Janet *out) {
+    JanetRecord *r = (JanetRecord *) p;
+    int32_t i = shape_find(r->shape, key);
+    if (i < 0) return 0;
+    *out = r->values[i];
+    return 1;
+}
+
+static Janet record_next(void *p, Janet key) {
+    JanetShape *s = ((JanetRecord *) p)->shape;
+    int32_t i = 0;
+    if (!janet_checktype(key, JANET_NIL)) {
+        i = shape_find(s, key);
+        if (i < 0) return janet_wrap_nil();
+        i++;
+    }
+    return i < s->count ? s->keys[i] : janet_wrap_nil();
+}
+
+static int32_t record_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetRecord *) p)->shape->count;
+}
+
+static void record_tostring(void *p, JanetBuffer *buffer) {
+    JanetRecord *r = (JanetRecord *) p;
+    janet_buffer_push_u8(buffer, '{');
+    for (int32_t i = 0; i < r->shape->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, r->shape->keys[i]);
+        janet_buffer_push_u8(buffer, ' ');
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, r->values[i]);
+    }
+    janet_buffer_push_u8(buffer, '}');
+}
+
+/* Records compare like structs, independent of the key order of their
+ * shapes: by size, then keys in order, then the values of those keys. */
+static int record_compare(void *lhs, void *rhs) {
+    JanetRecord *a = (JanetRecord *) lhs;
+    JanetRecord *b = (JanetRecord *) rhs;
+    JanetShape *sa = a->shape;
+    JanetShape *sb = b->shape;
+    if (sa->count != sb->count) return sa->count < sb->count ? -1 : 1;
+    if (sa != sb) {
+        for (int32_t i = 0; i < sa->count; i++) {
+            int diff = janet_compare(sa->keys[sa->order[i]], sb->keys[sb->order[i]]);
+            if (diff) return diff;
+        }
+    }
+    for (int32_t i = 0; i < sa->count; i++) {
+        int diff = janet_compare(a->values[sa->order[i]], b->values[sb->order[i]]);
+        if (diff) return diff;
+    }
+    return 0;
+}
+
+static int32_t record_hash(void *p, size_t size) {
+    (void) size;
+    JanetRecord *r = (JanetRecord *) p;
+    JanetShape *s = r->shape;
+    uint32_t hash = (uint32_t) s->count;
+    for (int32_t i = 0; i < s->count; i++) {
+        int32_t j = s->order[i];
+        hash = hash * 31 + (uint32_t) janet_hash(s->keys[j]);
+        hash = hash * 31 + (uint32_t) janet_hash(r->values[j]);
+    }
+    return (int32_t) hash;
+}
+
+static void record_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetRecord *r = (JanetRecord *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, r->shape->count);
+    janet_marshal_janet(ctx, janet_wrap_abstract(r->shape));
+    for (int32_t i = 0; i < r->shape->count; i++) {
+        janet_marshal_janet(ctx, r->values[i]);
+    }
+}
+
+static void *record_unmarshal(JanetMarshalContext *ctx) {
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid record size");
+    JanetRecord *r = janet_unmarshal_abstract(ctx, sizeof(JanetRecord) + (size_t) count * sizeof(Janet));
+    r->shape = NULL;
+    Janet shape = janet_unmarshal_janet(ctx);
+    if (!janet_checkabstract(shape, &janet_shape_type) ||
+            ((JanetShape *) janet_unwrap_abstract(shape))->count != count) {
+        janet_panic("expected shape of record");
+    }
+    for (int32_t i = 0; i < count; i++) {
+        r->values[i] = janet_wrap_nil();
+    }
+    r->shape = (JanetShape *) janet_unwrap_abstract(shape);
+    for (int32_t i = 0; i < count; i++) {
+        r->values[i] = janet_unmarshal_janet(ctx);
+    }
+    return r;
+}
+
+static const JanetAbstractType janet_record_type = {
+    "core/record",
+    NULL,
+    record_gcmark,
+    record_get,
+    NULL,
+    record_marshal,
+    record_unmarshal,
+    record_tostring,
+    record_compare,
+    record_hash,
+    record_next,
+    NULL,
+    record_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetShape *record_getshape(const Janet *argv, int32_t n) {
+    return (JanetShape *) janet_getabstract(argv, n, &janet_shape_type);
+}
+
+JANET_CORE_FN(cfun_record_shape,
+              "(record/shape & keys)",
+              "Create a shape, a fixed list of keys shared by the records built from it. "
+              "Calling the shape with one value per key builds a record, which behaves like an "
+              "immutable struct but stores only its values, so records from the same shape take "
+              "about half the memory of the equivalent structs.") {
+    return janet_wrap_abstract(shape_new(argv, argc));
+}
+
+JANET_CORE_FN(cfun_record_from,
+              "(record/from shape dict)",
+              "Build a record from the values of the keys of shape in a dictionary or record. "
+              "Keys missing from dict get nil.") {
+    janet_fixarity(argc, 2);
+    JanetShape *s = record_getshape(argv, 0);
+    JanetRecord *r = record_new(s);
+    for (int32_t i = 0; i < s->count; i++) {
+        r->values[i] = janet_get(argv[1], s->keys[i]);
+    }
+    return janet_wrap_abstract(r);
+}
+
+JANET_CORE_FN(cfun_record_shape_of,
+              "(record/shape-of record)",
+              "Get the shape a record was built from.") {
+    janet_fixarity(argc, 1);
+    JanetRecord *r = janet_getabstract(argv, 0, &janet_record_type);
+    return janet_wrap_abstract(r->shape);
+}
+
+JANET_CORE_FN(cfun_record_keys,
+              "(record/keys shape)",
+              "Get the keys of a shape as a tuple, in the order its records take values.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_tuple(record_getshape(argv, 0)->keys);
+}
+
+JANET_CORE_FN(cfun_record_to_struct,
+              "(record/to-struct record)",
+              "Convert a record to a struct with the same keys and values.") {
+    janet_fixarity(argc, 1);
+    JanetRecord *r = janet_getabstract(argv, 0, &janet_record_type);
+    JanetKV *st = janet_struct_begin(r->shape->count);
+    for (int32_t i = 0; i < r->shape->count; i++) {
+        janet_struct_put(st, r->shape->keys[i], r->values[i]);
+    }
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+void janet_lib_record(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_CORE_REG("record/shape", cfun_record_shape),
+        JANET_CORE_REG("record/from", cfun_record_from),
+        JANET_CORE_REG("record/shape-of", cfun_record_shape_of),
+        JANET_CORE_REG("record/keys", cfun_record_keys),
+        JANET_CORE_REG("record/to-struct", cfun_record_to_struct),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, cfuns);
+    janet_register_abstract_type(&janet_shape_type);
+    janet_register_abstract_type(&janet_record_type);
+}
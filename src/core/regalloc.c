@@ -161,3 +161,257 @@ void janetc_regalloc_freetemp(JanetcRegisterAllocator *ra, int32_t reg, JanetcRe
     if (reg < 0xF0)
         janetc_regalloc_free(ra, reg);
 }
+
+/* Liveness based register renaming. The first fit allocator above only frees
+ * named slots when their scope exits, so large functions hold many dead registers.
+ * After a function is compiled, compute which registers are live at each
+ * instruction, and give registers that are never live at the same time the
+ * same slot. */
+
+/* Registers are numbered below 0xF0 in the functions we rename */
+#define LIVE_CHUNKS 8
+
+typedef struct {
+    uint32_t bits[LIVE_CHUNKS];
+} LiveSet;
+
+#define live_has(S, R) ((S)->bits[(R) >> 5] & ithbit((R) & 0x1F))
+#define live_add(S, R) ((S)->bits[(R) >> 5] |= ithbit((R) & 0x1F))
+#define live_remove(S, R) ((S)->bits[(R) >> 5] &= ~ithbit((R) & 0x1F))
+
+/* Slots an instruction reads and writes. The first `ndefs` entries of
+ * regs are written, the rest are read. Fields holds the bit offset of
+ * each slot in the instruction. */
+typedef struct {
+    int32_t count;
+    int32_t ndefs;
+    int32_t regs[3];
+    int32_t fields[3];
+} InstrSlots;
+
+static void slots_push(InstrSlots *s, uint32_t instr, int32_t field, int32_t mask) {
+    s->fields[s->count] = field;
+    s->regs[s->count++] = (int32_t)((instr >> field) & mask);
+}
+
+static void instr_slots(uint32_t instr, InstrSlots *s) {
+    uint32_t op = instr & 0x7F;
+    s->count = 0;
+    s->ndefs = 0;
+    switch (janet_instructions[op]) {
+        case JINT_0:
+        case JINT_L:
+        case JINT_SU:
+            break;
+        case JINT_S:
+            slots_push(s, instr, 8, 0xFFFFFF);
+            switch (op) {
+                case JOP_LOAD_NIL:
+                case JOP_LOAD_TRUE:
+                case JOP_LOAD_FALSE:
+                case JOP_LOAD_SELF:
+                case JOP_MAKE_ARRAY:
+                case JOP_MAKE_BUFFER:
+                case JOP_MAKE_STRING:
+                case JOP_MAKE_STRUCT:
+                case JOP_MAKE_TABLE:
+                case JOP_MAKE_TUPLE:
+                case JOP_MAKE_BRACKET_TUPLE:
+                    s->ndefs = 1;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case JINT_ST:
+        case JINT_SL:
+            slots_push(s, instr, 8, 0xFF);
+            break;
+        case JINT_SI:
+        case JINT_SD:
+            slots_push(s, instr, 8, 0xFF);
+            s->ndefs = 1;
+            break;
+        case JINT_SC:
+        case JINT_SES:
+            slots_push(s, instr, 8, 0xFF);
+            s->ndefs = (op != JOP_JUMP_TABLE && op != JOP_SET_UPVALUE);
+            break;
+        case JINT_SS:
+            if (op == JOP_MOVE_FAR) {
+                slots_push(s, instr, 16, 0xFFFF);
+                slots_push(s, instr, 8, 0xFF);
+            } else {
+                slots_push(s, instr, 8, 0xFF);
+                slots_push(s, instr, 16, 0xFFFF);
+            }
+            s->ndefs = (op != JOP_PUSH_2);
+            break;
+        case JINT_SSI:
+        case JINT_SSU:
+            slots_push(s, instr, 8, 0xFF);
+            slots_push(s, instr, 16, 0xFF);
+            s->ndefs = (op != JOP_PUT_INDEX);
+            break;
+        case JINT_SSS:
+            slots_push(s, instr, 8, 0xFF);
+            slots_push(s, instr, 16, 0xFF);
+            slots_push(s, instr, 24, 0xFF);
+            s->ndefs = (op != JOP_PUSH_3 && op != JOP_PUT);
+            break;
+    }
+}
+
+/* Get the instructions that may run after instruction i. Returns the number of
+ * successors written to out. */
+static int32_t instr_successors(JanetFuncDef *def, int32_t i, int32_t *out) {
+    uint32_t instr = def->bytecode[i];
+    int32_t n = 0;
+    switch (instr & 0x7F) {
+        case JOP_RETURN:
+        case JOP_RETURN_NIL:
+        case JOP_ERROR:
+        case JOP_TAILCALL:
+            return 0;
+        case JOP_JUMP:
+            out[0] = i + (((int32_t) instr) >> 8);
+            return 1;
+        case JOP_JUMP_IF:
+        case JOP_JUMP_IF_NOT:
+        case JOP_JUMP_IF_NIL:
+        case JOP_JUMP_IF_NOT_NIL:
+            out[n++] = i + (((int32_t) instr) >> 16);
+            break;
+        case JOP_JUMP_TABLE: {
+            const JanetKV *st = janet_unwrap_struct(def->constants[instr >> 16]);
+            for (int32_t j = 0; j < janet_struct_capacity(st); j++) {
+                if (janet_checktype(st[j].key, JANET_NIL)) continue;
+                out[n++] = i + janet_unwrap_integer(st[j].value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (i + 1 < def->bytecode_length) out[n++] = i + 1;
+    return n;
+}
+
+void janetc_regalloc_liveness(JanetFuncDef *def) {
+    int32_t len = def->bytecode_length;
+    int32_t nparams = def->arity + !!(def->flags & JANET_FUNCDEF_FLAG_VARARG);
+    int32_t nslots = def->slotcount;
+    int32_t maxsucc = 2;
+
+    /* Far slots are moved through reserved registers, leave them alone */
+    if (len == 0 || nslots == 0 || nslots > 0xF0) return;
+
+    for (int32_t i = 0; i < len; i++) {
+        if ((def->bytecode[i] & 0x7F) == JOP_JUMP_TABLE) {
+            int32_t n = janet_struct_length(janet_unwrap_struct(def->constants[def->bytecode[i] >> 16]));
+            if (n + 1 > maxsucc) maxsucc = n + 1;
+        }
+    }
+    int32_t *succ = janet_malloc(sizeof(int32_t) * (size_t) maxsucc);
+    LiveSet *live = janet_calloc((size_t) len, sizeof(LiveSet));
+    LiveSet *graph = janet_calloc((size_t) nslots, sizeof(LiveSet));
+    if (NULL == succ || NULL == live || NULL == graph) {
+        JANET_OUT_OF_MEMORY;
+    }
+
+    /* Find the registers live on entry to each instruction, iterating backwards
+     * until nothing changes. */
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int32_t i = len - 1; i >= 0; i--) {
+            LiveSet in;
+            InstrSlots s;
+            int32_t nsucc = instr_successors(def, i, succ);
+            memset(&in, 0, sizeof(in));
+            for (int32_t j = 0; j < nsucc; j++) {
+                for (int32_t k = 0; k < LIVE_CHUNKS; k++) {
+                    in.bits[k] |= live[succ[j]].bits[k];
+                }
+            }
+            instr_slots(def->bytecode[i], &s);
+            for (int32_t j = 0; j < s.ndefs; j++) live_remove(&in, s.regs[j]);
+            for (int32_t j = s.ndefs; j < s.count; j++) live_add(&in, s.regs[j]);
+            if (memcmp(&in, live + i, sizeof(in))) {
+                live[i] = in;
+                changed = 1;
+            }
+        }
+    }
+
+    /* Registers written while another is live can not share a slot with it */
+    LiveSet used;
+    memset(&used, 0, sizeof(used));
+    for (int32_t i = 0; i < len; i++) {
+        InstrSlots s;
+        LiveSet out;
+        int32_t nsucc = instr_successors(def, i, succ);
+        memset(&out, 0, sizeof(out));
+        for (int32_t j = 0; j < nsucc; j++) {
+            for (int32_t k = 0; k < LIVE_CHUNKS; k++) {
+                out.bits[k] |= live[succ[j]].bits[k];
+            }
+        }
+        instr_slots(def->bytecode[i], &s);
+        for (int32_t j = 0; j < s.count; j++) live_add(&used, s.regs[j]);
+        for (int32_t j = 0; j < s.ndefs; j++) {
+            int32_t d = s.regs[j];
+            for (int32_t r = 0; r < nslots; r++) {
+                if (r != d && live_has(&out, r)) {
+                    live_add(graph + d, r);
+                    live_add(graph + r, d);
+                }
+            }
+        }
+    }
+
+    /* Registers live on entry hold arguments (or nil), and registers captured
+     * by closures can be accessed at any time, so those keep their slots. */
+    int32_t color[0xF0];
+    LiveSet reserved;
+    memset(&reserved, 0, sizeof(reserved));
+    for (int32_t r = 0; r < nslots; r++) {
+        int captured = def->closure_bitset &&
+                       (def->closure_bitset[r >> 5] & ithbit(r & 0x1F));
+        color[r] = -1;
+        if (captured) live_add(&reserved, r);
+        if (captured || live_has(live, r)) color[r] = r;
+    }
+    int32_t newcount = nparams;
+    for (int32_t r = 0; r < nslots; r++) {
+        if (color[r] >= 0 && color[r] + 1 > newcount) newcount = color[r] + 1;
+    }
+    for (int32_t r = 0; r < nslots; r++) {
+        if (color[r] >= 0 || !live_has(&used, r)) continue;
+        LiveSet taken = reserved;
+        for (int32_t n = 0; n < nslots; n++) {
+            if (live_has(graph + r, n) && color[n] >= 0) live_add(&taken, color[n]);
+        }
+        int32_t c = 0;
+        while (live_has(&taken, c)) c++;
+        color[r] = c;
+        if (c + 1 > newcount) newcount = c + 1;
+    }
+
+    /* Rewrite the bytecode with the new slots */
+    for (int32_t i = 0; i < len; i++) {
+        InstrSlots s;
+        uint32_t instr = def->bytecode[i];
+        instr_slots(instr, &s);
+        for (int32_t j = 0; j < s.count; j++) {
+            instr &= ~((uint32_t) 0xFF << s.fields[j]);
+            instr |= (uint32_t) color[s.regs[j]] << s.fields[j];
+        }
+        def->bytecode[i] = instr;
+    }
+    def->slotcount = newcount;
+
+    janet_free(succ);
+    janet_free(live);
+    janet_free(graph);
+}
@@ -20,12 +20,14 @@
 * IN THE SOFTWARE.
 */
 
-/* Implements a simple first fit register allocator for the compiler. */
+/* Implements a simple first fit register allocator for the compiler, and
+ * a liveness pass that shrinks the frames of compiled functions. */
 
 #ifndef JANET_REGALLOC_H
 #define JANET_REGALLOC_H
 
 #include <stdint.h>
+#include <janet.h>
 
 /* Placeholder for allocating temporary registers */
 typedef enum {
@@ -56,5 +58,6 @@ int32_t janetc_regalloc_temp(JanetcRegisterAllocator *ra, JanetcRegisterTemp nth
 void janetc_regalloc_freetemp(JanetcRegisterAllocator *ra, int32_t reg, JanetcRegisterTemp nth);
 void janetc_regalloc_clone(JanetcRegisterAllocator *dest, JanetcRegisterAllocator *src);
 void janetc_regalloc_touch(JanetcRegisterAllocator *ra, int32_t reg);
+void janetc_regalloc_liveness(JanetFuncDef *def);
 
 #endif
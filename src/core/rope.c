@@ -0,0 +1,398 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+/*
+ * Ropes are immutable byte sequences built from a balanced (AVL) tree of
+ * concatenations. Leaves point into strings, so slicing and concatenation
+ * share bytes instead of copying them. A rope is flattened into a single
+ * string the first time something needs contiguous bytes, and the string is
+ * kept with the rope for later uses.
+ */
+
+/* Adjacent leaves shorter than this together are merged into one leaf */
+#define JANET_ROPE_LEAF 256
+
+/* Pieces split from bytes shorter than this are copied into strings, which
+ * take less memory than a leaf at that size */
+#define JANET_ROPE_SHARE 64
+
+struct JanetRope {
+    int32_t length;
+    int32_t height;
+    JanetRope *left;
+    JanetRope *right;
+    /* The bytes of a leaf, or the flattened bytes of a concatenation once
+     * it has been flattened (NULL until then). */
+    JanetString source;
+    int32_t offset;
+};
+
+static int rope_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetRope *r = (JanetRope *) p;
+    if (r->left) {
+        janet_mark(janet_wrap_abstract(r->left));
+        janet_mark(janet_wrap_abstract(r->right));
+    }
+    if (r->source) janet_mark(janet_wrap_string(r->source));
+    return 0;
+}
+
+static JanetRope *rope_leaf(JanetString source, int32_t offset, int32_t length) {
+    JanetRope *r = janet_abstract(&janet_rope_type, sizeof(JanetRope));
+    r->length = length;
+    r->height = 0;
+    r->left = NULL;
+    r->right = NULL;
+    r->source = source;
+    r->offset = offset;
+    return r;
+}
+
+static JanetRope *rope_node(JanetRope *left, JanetRope *right) {
+    if (left->length > INT32_MAX - right->length) janet_panic("rope too long");
+    JanetRope *r = janet_abstract(&janet_rope_type, sizeof(JanetRope));
+    r->length = left->length + right->length;
+    r->height = 1 + (left->height > right->height ? left->height : right->height);
+    r->left = left;
+    r->right = right;
+    r->source = NULL;
+    r->offset = 0;
+    return r;
+}
+
+/* Copy the bytes of a rope to dest */
+static void rope_copy(JanetRope *r, uint8_t *dest) {
+    while (r->source == NULL) {
+        rope_copy(r->left, dest);
+        dest += r->left->length;
+        r = r->right;
+    }
+    memcpy(dest, r->source + r->offset, r->length);
+}
+
+JanetString janet_rope_flatten(JanetRope *r) {
+    if (r->source && r->offset == 0 && r->length == janet_string_length(r->source)) {
+        return r->source;
+    }
+    uint8_t *str = janet_string_begin(r->length);
+    rope_copy(r, str);
+    r->source = janet_string_end(str);
+    r->offset = 0;
+    return r->source;
+}
+
+/* Get the bytes of a rope. A leaf is read in place and other ropes are
+ * flattened, so slices of strings are never copied. */
+const uint8_t *janet_rope_bytes(JanetRope *r, int32_t *len) {
+    *len = r->length;
+    if (r->source) return r->source + r->offset;
+    return janet_rope_flatten(r);
+}
+
+/* Two short leaves become one leaf */
+static JanetRope *rope_merge(JanetRope *a, JanetRope *b) {
+    if (a->left || b->left || a->length + b->length > JANET_ROPE_LEAF) return NULL;
+    uint8_t *str = janet_string_begin(a->length + b->length);
+    memcpy(str, a->source + a->offset, a->length);
+    memcpy(str + a->length, b->source + b->offset, b->length);
+    return rope_leaf(janet_string_end(str), 0, a->length + b->length);
+}
+
+/* (x (y z)) -> ((x y) z) */
+static JanetRope *rope_rotate_left(JanetRope *r) {
+    return rope_node(rope_node(r->left, r->right->left), r->right->right);
+}
+
+/* ((x y) z) -> (x (y z)) */
+static JanetRope *rope_rotate_right(JanetRope *r) {
+    return rope_node(r->left->left, rope_node(r->left->right, r->right));
+}
+
+/* Join along the right spine of a, which is more than one level taller than b */
+static JanetRope *rope_join_right(JanetRope *a, JanetRope *b) {
+    JanetRope *l = a->left;
+    JanetRope *c = a->right;
+    if (c->height <= b->height + 1) {
+        JanetRope *t = rope_merge(c, b);
+        if (t == NULL) t = rope_node(c, b);
+        if (t->height <= l->height + 1) return rope_node(l, t);
+        return rope_rotate_left(rope_node(l, rope_rotate_right(t)));
+    }
+    JanetRope *t = rope_join_right(c, b);
+    JanetRope *joined = rope_node(l, t);
+    if (t->height <= l->height + 1) return joined;
+    return rope_rotate_left(joined);
+}
+
+/* Join along the left spine of b, which is more than one level taller than a */
+static JanetRope *rope_join_left(JanetRope *a, JanetRope *b) {
+    JanetRope *c = b->left;
+    JanetRope *r = b->right;
+    if (c->height <= a->height + 1) {
+        JanetRope *t = rope_merge(a, c);
+        if (t == NULL) t = rope_node(a, c);
+        if (t->height <= r->height + 1) return rope_node(t, r);
+        return rope_rotate_right(rope_node(rope_rotate_left(t), r));
+    }
+    JanetRope *t = rope_join_left(a, c);
+    JanetRope *joined = rope_node(t, r);
+    if (t->height <= r->height + 1) return joined;
+    return rope_rotate_right(joined);
+}
+
+static JanetRope *rope_concat(JanetRope *a, JanetRope *b) {
+    if (a->length == 0) return b;
+    if (b->length == 0) return a;
+    if (a->height > b->height + 1) return rope_join_right(a, b);
+    if (b->height > a->height + 1) return rope_join_left(a, b);
+    JanetRope *merged = rope_merge(a, b);
+    return merged ? merged : rope_node(a, b);
+}
+
+static JanetRope *rope_slice(JanetRope *r, int32_t start, int32_t end) {
+    if (start == 0 && end == r->length) return r;
+    if (r->source) return rope_leaf(r->source, r->offset + start, end - start);
+    int32_t split = r->left->length;
+    if (end <= split) return rope_slice(r->left, start, end);
+    if (start >= split) return rope_slice(r->right, start - split, end - split);
+    return rope_concat(rope_slice(r->left, start, split), rope_slice(r->right, 0, end - split));
+}
+
+/* Get a rope for a rope or byte sequence argument. Buffers are copied. */
+static JanetRope *rope_getpart(const Janet *argv, int32_t n) {
+    Janet x = argv[n];
+    switch (janet_type(x)) {
+        default:
+            break;
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD: {
+            JanetString str = janet_unwrap_string(x);
+            return rope_leaf(str, 0, janet_string_length(str));
+        }
+        case JANET_BUFFER: {
+            JanetBuffer *buffer = janet_unwrap_buffer(x);
+            return rope_leaf(janet_string(buffer->data, buffer->count), 0, buffer->count);
+        }
+        case JANET_ABSTRACT:
+            if (janet_abstract_type(janet_unwrap_abstract(x)) == &janet_rope_type) {
+                return (JanetRope *) janet_unwrap_abstract(x);
+            }
+            break;
+    }
+    janet_panicf("bad slot #%d, expected rope or bytes, got %v", n, x);
+}
+
+static int rope_get(void *p, Janet key, Janet *out) {
+    JanetRope *r = (JanetRope *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= r->length) return 0;
+    while (r->source == NULL) {
+        if (i < r->left->length) {
+            r = r->left;
+        } else {
+            i -= r->left->length;
+            r = r->right;
+        }
+    }
+    *out = janet_wrap_integer(r->source[r->offset + i]);
+    return 1;
+}
+
+static Janet rope_next(void *p, Janet key) {
+    JanetRope *r = (JanetRope *) p;
+    if (janet_checktype(key, JANET_NIL)) {
+        return r->length ? janet_wrap_integer(0) : janet_wrap_nil();
+    }
+    if (!janet_checkint(key)) return janet_wrap_nil();
+    int32_t i = janet_unwrap_integer(key);
+    return (i >= 0 && i + 1 < r->length) ? janet_wrap_integer(i + 1) : janet_wrap_nil();
+}
+
+static int32_t rope_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetRope *) p)->length;
+}
+
+/* Write the leaves straight into the buffer without flattening */
+static void rope_tostring(void *p, JanetBuffer *buffer) {
+    JanetRope *r = (JanetRope *) p;
+    janet_buffer_ensure(buffer, buffer->count + r->length, 2);
+    rope_copy(r, buffer->data + buffer->count);
+    buffer->count += r->length;
+}
+
+static int rope_compare(void *lhs, void *rhs) {
+    return janet_string_compare(janet_rope_flatten((JanetRope *) lhs),
+                                janet_rope_flatten((JanetRope *) rhs));
+}
+
+static int32_t rope_hash(void *p, size_t size) {
+    (void) size;
+    return janet_string_hash(janet_rope_flatten((JanetRope *) p));
+}
+
+static void rope_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetRope *r = (JanetRope *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, r->length);
+    janet_marshal_bytes(ctx, janet_rope_flatten(r), r->length);
+}
+
+static void *rope_unmarshal(JanetMarshalContext *ctx) {
+    JanetRope *r = janet_unmarshal_abstract(ctx, sizeof(JanetRope));
+    int32_t length = janet_unmarshal_int(ctx);
+    if (length < 0) janet_panic("invalid rope length");
+    if (length > 0) janet_unmarshal_ensure(ctx, length - 1);
+    uint8_t *str = janet_string_begin(length);
+    janet_unmarshal_bytes(ctx, str, length);
+    r->length = length;
+    r->height = 0;
+    r->left = NULL;
+    r->right = NULL;
+    r->source = janet_string_end(str);
+    r->offset = 0;
+    return r;
+}
+
+const JanetAbstractType janet_rope_type = {
+    "core/rope",
+    NULL,
+    rope_gcmark,
+    rope_get,
+    NULL,
+    rope_marshal,
+    rope_unmarshal,
+    rope_tostring,
+    rope_compare,
+    rope_hash,
+    rope_next,
+    NULL,
+    rope_length,
+    JANET_ATEND_LENGTH
+};
+
+JANET_CORE_FN(cfun_rope_new,
+              "(rope/new & parts)",
+              "Concatenate ropes, strings, symbols, keywords and buffers into a rope. "
+              "Joining two ropes takes O(log n) time and copies no bytes from either, "
+              "which makes ropes a good fit for building large strings piece by piece. "
+              "Functions that need contiguous bytes, such as the string functions, "
+              "accept ropes and flatten them once; use string or buffer/push to copy "
+              "the bytes out directly.") {
+    JanetRope *r = rope_leaf(janet_cstring(""), 0, 0);
+    for (int32_t i = 0; i < argc; i++) {
+        r = rope_concat(r, rope_getpart(argv, i));
+    }
+    return janet_wrap_abstract(r);
+}
+
+JANET_CORE_FN(cfun_rope_slice,
+              "(rope/slice bytes &opt start end)",
+              "Get a slice of a rope, string, symbol, keyword or buffer as a rope, with start "
+              "and end indices like string/slice. The slice shares bytes with a rope or string "
+              "instead of copying them, and functions that take bytes read it in place. The "
+              "slice keeps its source alive until it is flattened, which happens the first "
+              "time it is hashed or compared; use string to get a detached copy.") {
+    janet_arity(argc, 1, 3);
+    JanetRope *r = rope_getpart(argv, 0);
+    JanetRange range = janet_getslice(argc, argv);
+    return janet_wrap_abstract(rope_slice(r, range.start, range.end));
+}
+
+/* Index of the first match of pat in text at or after from, or -1 */
+static int32_t rope_find(const uint8_t *text, int32_t len, int32_t from, JanetByteView pat) {
+    int32_t last = len - pat.len;
+    while (from <= last) {
+        const uint8_t *hit = memchr(text + from, pat.bytes[0], (size_t)(last - from + 1));
+        if (hit == NULL) return -1;
+        from = (int32_t)(hit - text);
+        if (!memcmp(hit, pat.bytes, pat.len)) return from;
+        from++;
+    }
+    return -1;
+}
+
+static Janet rope_piece(JanetString source, int32_t offset, int32_t length) {
+    if (length < JANET_ROPE_SHARE) return janet_stringv(source + offset, length);
+    return janet_wrap_abstract(rope_leaf(source, offset, length));
+}
+
+JANET_CORE_FN(cfun_rope_split,
+              "(rope/split delim bytes &opt start limit)",
+              "Split bytes with delimiter delim like string/split, but return pieces that "
+              "share bytes with the input instead of copying them. Pieces of at least 64 "
+              "bytes are ropes as from rope/slice, and shorter pieces, which take less memory "
+              "as a copy, are strings. A buffer is copied once up front.") {
+    janet_arity(argc, 2, 4);
+    JanetByteView delim = janet_getbytes(argv, 0);
+    if (delim.len == 0) janet_panic("expected non-empty pattern");
+    JanetRope *r = rope_getpart(argv, 1);
+    if (r->source == NULL) janet_rope_flatten(r);
+    JanetString source = r->source;
+    const uint8_t *text = source + r->offset;
+    int32_t start = 0;
+    if (argc >= 3) {
+        start = janet_getinteger(argv, 2);
+        if (start < 0) janet_panic("expected non-negative start index");
+    }
+    int32_t limit = argc >= 4 ? janet_getinteger(argv, 3) : -1;
+    JanetArray *array = janet_array(0);
+    int32_t last = 0;
+    int32_t found;
+    while ((found = rope_find(text, r->length, start, delim)) >= 0 && --limit) {
+        janet_array_push(array, rope_piece(source, r->offset + last, found - last));
+        last = start = found + delim.len;
+    }
+    janet_array_push(array, rope_piece(source, r->offset + last, r->length - last));
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_rope_flatten,
+              "(rope/flatten rope)",
+              "Get the contents of a rope as a string. The string is cached, so "
+              "flattening a rope again is O(1).") {
+    janet_fixarity(argc, 1);
+    JanetRope *r = janet_getabstract(argv, 0, &janet_rope_type);
+    return janet_wrap_string(janet_rope_flatten(r));
+}
+
+/* Module entry point */
+void janet_lib_rope(JanetTable *env) {
+    JanetRegExt rope_cfuns[] = {
+        JANET_CORE_REG("rope/new", cfun_rope_new),
+        JANET_CORE_REG("rope/slice", cfun_rope_slice),
+        JANET_CORE_REG("rope/split", cfun_rope_split),
+        JANET_CORE_REG("rope/flatten", cfun_rope_flatten),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, rope_cfuns);
+    janet_register_abstract_type(&janet_rope_type);
+}
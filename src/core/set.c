@@ -0,0 +1,455 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+
+/*
+ * Hash sets. A set is an open addressed table of bare keys with linear
+ * probing, so an entry takes a single Janet instead of the key value pair
+ * a table would use. Removal shifts later entries of a probe run back
+ * instead of leaving tombstones. Sets come in a mutable kind and a frozen
+ * kind, which compares and hashes by value like a struct.
+ */
+
+typedef struct {
+    int32_t count;
+    int32_t capacity;
+    int32_t hash;
+    Janet *slots;
+} JanetSet;
+
+static const JanetAbstractType janet_set_type;
+static const JanetAbstractType janet_frozenset_type;
+
+static int set_valid_key(Janet key) {
+    if (janet_checktype(key, JANET_NIL)) return 0;
+    if (janet_checktype(key, JANET_NUMBER) && isnan(janet_unwrap_number(key))) return 0;
+    return 1;
+}
+
+/* Index of key, or -1 if it is missing */
+static int32_t set_find(const JanetSet *s, Janet key) {
+    if (!s->capacity) return -1;
+    uint32_t mask = (uint32_t) s->capacity - 1;
+    for (uint32_t i = (uint32_t) janet_hash(key) & mask;; i = (i + 1) & mask) {
+        if (janet_checktype(s->slots[i], JANET_NIL)) return -1;
+        if (janet_equals(s->slots[i], key)) return (int32_t) i;
+    }
+}
+
+static void set_insert_new(JanetSet *s, Janet key) {
+    uint32_t mask = (uint32_t) s->capacity - 1;
+    uint32_t i = (uint32_t) janet_hash(key) & mask;
+    while (!janet_checktype(s->slots[i], JANET_NIL)) i = (i + 1) & mask;
+    s->slots[i] = key;
+    s->count++;
+}
+
+static void set_rehash(JanetSet *s, int32_t capacity) {
+    Janet *old = s->slots;
+    int32_t oldcap = s->capacity;
+    Janet *slots = janet_malloc((size_t) capacity * sizeof(Janet));
+    if (NULL == slots) {
+        JANET_OUT_OF_MEMORY;
+    }
+    for (int32_t i = 0; i < capacity; i++) slots[i] = janet_wrap_nil();
+    s->slots = slots;
+    s->capacity = capacity;
+    s->count = 0;
+    for (int32_t i = 0; i < oldcap; i++) {
+        if (!janet_checktype(old[i], JANET_NIL)) set_insert_new(s, old[i]);
+    }
+    janet_free(old);
+}
+
+/* Keep the load factor at most 3/4 */
+static void set_ensure(JanetSet *s, int32_t count) {
+    if ((int64_t) count * 4 <= (int64_t) s->capacity * 3) return;
+    if (count > (1 << 29)) janet_panic("set too large");
+    int32_t capacity = 8;
+    while (capacity * 3 < count * 4) capacity <<= 1;
+    set_rehash(s, capacity);
+}
+
+static void set_add(JanetSet *s, Janet key) {
+    if (!set_valid_key(key) || set_find(s, key) >= 0) return;
+    set_ensure(s, s->count + 1);
+    set_insert_new(s, key);
+}
+
+static void set_remove(JanetSet *s, Janet key) {
+    int32_t found = set_find(s, key);
+    if (found < 0) return;
+    uint32_t mask = (uint32_t) s->capacity - 1;
+    uint32_t hole = (uint32_t) found;
+    /* Shift back any later entry whose home slot is not between the hole
+     * and its current slot */
+    for (uint32_t i = (hole + 1) & mask; !janet_checktype(s->slots[i], JANET_NIL); i = (i + 1) & mask) {
+        uint32_t home = (uint32_t) janet_hash(s->slots[i]) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            s->slots[hole] = s->slots[i];
+            hole = i;
+        }
+    }
+    s->slots[hole] = janet_wrap_nil();
+    s->count--;
+}
+
+static void set_init(JanetSet *s, int32_t count) {
+    s->count = 0;
+    s->capacity = 0;
+    s->hash = 0;
+    s->slots = NULL;
+    if (count > 0) set_ensure(s, count);
+}
+
+static JanetSet *set_new(const JanetAbstractType *type, int32_t count) {
+    JanetSet *s = janet_abstract(type, sizeof(JanetSet));
+    set_init(s, count);
+    return s;
+}
+
+static int set_gc(void *p, size_t size) {
+    (void) size;
+    janet_free(((JanetSet *) p)->slots);
+    return 0;
+}
+
+static int set_gcmark(void *p, size_t size) {
+    (void) size;
+    JanetSet *s = (JanetSet *) p;
+    for (int32_t i = 0; i < s->capacity; i++) {
+        janet_mark(s->slots[i]);
+    }
+    return 0;
+}
+
+/* Members map to true, like the tables sets are often emulated with */
+static int set_get(void *p, Janet key, Janet *out) {
+    if (set_find((JanetSet *) p, key) < 0) return 0;
+    *out = janet_wrap_true();
+    return 1;
+}
+
+static void set_put(void *p, Janet key, Janet value) {
+    if (janet_truthy(value)) {
+        set_add((JanetSet *) p, key);
+    } else {
+        set_remove((JanetSet *) p, key);
+    }
+}
+
+static Janet set_next(void *p, Janet key) {
+    JanetSet *s = (JanetSet *) p;
+    int32_t i = 0;
+    if (!janet_checktype(key, JANET_NIL)) {
+        i = set_find(s, key);
+        if (i < 0) return janet_wrap_nil();
+        i++;
+    }
+    for (; i < s->capacity; i++) {
+        if (!janet_checktype(s->slots[i], JANET_NIL)) return s->slots[i];
+    }
+    return janet_wrap_nil();
+}
+
+static int32_t set_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetSet *) p)->count;
+}
+
+static void set_tostring(void *p, JanetBuffer *buffer) {
+    JanetSet *s = (JanetSet *) p;
+    int first = 1;
+    janet_buffer_push_cstring(buffer, "#{");
+    for (int32_t i = 0; i < s->capacity; i++) {
+        if (janet_checktype(s->slots[i], JANET_NIL)) continue;
+        if (!first) janet_buffer_push_u8(buffer, ' ');
+        first = 0;
+        janet_pretty(buffer, 4, JANET_PRETTY_ONELINE, s->slots[i]);
+    }
+    janet_buffer_push_u8(buffer, '}');
+}
+
+/* Order independent, so equal sets hash the same */
+static int32_t set_hash(void *p, size_t size) {
+    (void) size;
+    JanetSet *s = (JanetSet *) p;
+    if (!s->hash) {
+        uint32_t hash = 0;
+        for (int32_t i = 0; i < s->capacity; i++) {
+            if (janet_checktype(s->slots[i], JANET_NIL)) continue;
+            uint32_t h = (uint32_t) janet_hash(s->slots[i]);
+            hash += h ^ (0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+        s->hash = hash ? (int32_t) hash : 1;
+    }
+    return s->hash;
+}
+
+static int set_subset(const JanetSet *a, const JanetSet *b) {
+    if (a->count > b->count) return 0;
+    for (int32_t i = 0; i < a->capacity; i++) {
+        if (janet_checktype(a->slots[i], JANET_NIL)) continue;
+        if (set_find(b, a->slots[i]) < 0) return 0;
+    }
+    return 1;
+}
+
+/* Sets order by size and hash first, like structs. Unequal sets that agree
+ * on both fall back to identity. */
+static int set_compare(void *lhs, void *rhs) {
+    JanetSet *a = (JanetSet *) lhs;
+    JanetSet *b = (JanetSet *) rhs;
+    if (a->count != b->count) return a->count < b->count ? -1 : 1;
+    int32_t ha = set_hash(a, 0);
+    int32_t hb = set_hash(b, 0);
+    if (ha != hb) return ha < hb ? -1 : 1;
+    if (set_subset(a, b)) return 0;
+    return a > b ? 1 : -1;
+}
+
+static void set_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetSet *s = (JanetSet *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, s->count);
+    for (int32_t i = 0; i < s->capacity; i++) {
+        if (!janet_checktype(s->slots[i], JANET_NIL)) janet_marshal_janet(ctx, s->slots[i]);
+    }
+}
+
+static void *set_unmarshal(JanetMarshalContext *ctx) {
+    JanetSet *s = janet_unmarshal_abstract(ctx, sizeof(JanetSet));
+    set_init(s, 0);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid set size");
+    for (int32_t i = 0; i < count; i++) {
+        set_add(s, janet_unmarshal_janet(ctx));
+    }
+    return s;
+}
+
+static const JanetAbstractType janet_set_type = {
+    "core/set",
+    set_gc,
+    set_gcmark,
+    set_get,
+    set_put,
+    set_marshal,
+    set_unmarshal,
+    set_tostring,
+    NULL,
+    NULL,
+    set_next,
+    NULL,
+    set_length,
+    JANET_ATEND_LENGTH
+};
+
+static const JanetAbstractType janet_frozenset_type = {
+    "core/frozen-set",
+    set_gc,
+    set_gcmark,
+    set_get,
+    NULL,
+    set_marshal,
+    set_unmarshal,
+    set_tostring,
+    set_compare,
+    set_hash,
+    set_next,
+    NULL,
+    set_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetSet *set_getset(const Janet *argv, int32_t n) {
+    if (janet_checktype(argv[n], JANET_ABSTRACT)) {
+        void *p = janet_unwrap_abstract(argv[n]);
+        const JanetAbstractType *at = janet_abstract_type(p);
+        if (at == &janet_set_type || at == &janet_frozenset_type) return (JanetSet *) p;
+    }
+    janet_panic_type(argv[n], n, JANET_TFLAG_ABSTRACT);
+}
+
+static JanetSet *set_copy(const JanetAbstractType *type, const JanetSet *from) {
+    JanetSet *s = set_new(type, from->count);
+    for (int32_t i = 0; i < from->capacity; i++) {
+        if (!janet_checktype(from->slots[i], JANET_NIL)) set_insert_new(s, from->slots[i]);
+    }
+    return s;
+}
+
+static Janet set_build(const JanetAbstractType *type, int32_t argc, Janet *argv) {
+    JanetSet *s = set_new(type, argc);
+    for (int32_t i = 0; i < argc; i++) {
+        set_add(s, argv[i]);
+    }
+    return janet_wrap_abstract(s);
+}
+
+JANET_CORE_FN(cfun_set_new,
+              "(set/new & xs)",
+              "Create a mutable set of xs. Sets only store keys, so they take about half the "
+              "memory of a table mapping keys to true, and behave like one: getting a member "
+              "gives true, iterating gives the members as keys, and putting a truthy value adds "
+              "a key while putting a falsey value removes it. nil and NaN are never members.") {
+    return set_build(&janet_set_type, argc, argv);
+}
+
+JANET_CORE_FN(cfun_set_frozen,
+              "(set/frozen & xs)",
+              "Create an immutable set of xs. Immutable sets are compared and hashed by value, "
+              "so they can be used as table keys. See set/new.") {
+    return set_build(&janet_frozenset_type, argc, argv);
+}
+
+JANET_CORE_FN(cfun_set_freeze,
+              "(set/freeze s)",
+              "Get an immutable copy of a set.") {
+    janet_fixarity(argc, 1);
+    JanetSet *s = set_getset(argv, 0);
+    return janet_wrap_abstract(set_copy(&janet_frozenset_type, s));
+}
+
+JANET_CORE_FN(cfun_set_add,
+              "(set/add s & xs)",
+              "Add xs to a mutable set. Returns the set.") {
+    janet_arity(argc, 1, -1);
+    JanetSet *s = janet_getabstract(argv, 0, &janet_set_type);
+    set_ensure(s, s->count + argc - 1);
+    for (int32_t i = 1; i < argc; i++) {
+        set_add(s, argv[i]);
+    }
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_set_remove,
+              "(set/remove s & xs)",
+              "Remove xs from a mutable set. Returns the set.") {
+    janet_arity(argc, 1, -1);
+    JanetSet *s = janet_getabstract(argv, 0, &janet_set_type);
+    for (int32_t i = 1; i < argc; i++) {
+        set_remove(s, argv[i]);
+    }
+    return argv[0];
+}
+
+static const JanetAbstractType *set_result_type(const Janet *argv) {
+    return janet_abstract_type(janet_unwrap_abstract(argv[0]));
+}
+
+JANET_CORE_FN(cfun_set_union,
+              "(set/union s & more)",
+              "Get a new set of the members of any of the given sets. The result is mutable "
+              "if the first set is.") {
+    janet_arity(argc, 1, -1);
+    JanetSet *first = set_getset(argv, 0);
+    int64_t total = first->count;
+    for (int32_t i = 1; i < argc; i++) total += set_getset(argv, i)->count;
+    JanetSet *out = set_copy(set_result_type(argv), first);
+    set_ensure(out, total > INT32_MAX ? INT32_MAX : (int32_t) total);
+    for (int32_t i = 1; i < argc; i++) {
+        JanetSet *s = set_getset(argv, i);
+        for (int32_t j = 0; j < s->capacity; j++) {
+            if (!janet_checktype(s->slots[j], JANET_NIL)) set_add(out, s->slots[j]);
+        }
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_CORE_FN(cfun_set_intersection,
+              "(set/intersection s & more)",
+              "Get a new set of the members of s that are in all of the other sets. The result "
+              "is mutable if s is.") {
+    janet_arity(argc, 1, -1);
+    /* Walk the smallest set and probe the others */
+    int32_t smallest = 0;
+    for (int32_t i = 0; i < argc; i++) {
+        if (set_getset(argv, i)->count < set_getset(argv, smallest)->count) smallest = i;
+    }
+    JanetSet *walk = set_getset(argv, smallest);
+    JanetSet *out = set_new(set_result_type(argv), 0);
+    for (int32_t j = 0; j < walk->capacity; j++) {
+        Janet key = walk->slots[j];
+        if (janet_checktype(key, JANET_NIL)) continue;
+        int32_t i;
+        for (i = 0; i < argc; i++) {
+            if (i != smallest && set_find(set_getset(argv, i), key) < 0) break;
+        }
+        if (i == argc) set_add(out, key);
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_CORE_FN(cfun_set_difference,
+              "(set/difference s & more)",
+              "Get a new set of the members of s that are in none of the other sets. The result "
+              "is mutable if s is.") {
+    janet_arity(argc, 1, -1);
+    JanetSet *first = set_getset(argv, 0);
+    for (int32_t i = 1; i < argc; i++) set_getset(argv, i);
+    JanetSet *out = set_new(set_result_type(argv), 0);
+    for (int32_t j = 0; j < first->capacity; j++) {
+        Janet key = first->slots[j];
+        if (janet_checktype(key, JANET_NIL)) continue;
+        int32_t i;
+        for (i = 1; i < argc; i++) {
+            if (set_find(janet_unwrap_abstract(argv[i]), key) >= 0) break;
+        }
+        if (i == argc) set_add(out, key);
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_CORE_FN(cfun_set_subset,
+              "(set/subset? a b)",
+              "Check if every member of set a is a member of set b.") {
+    janet_fixarity(argc, 2);
+    return janet_wrap_boolean(set_subset(set_getset(argv, 0), set_getset(argv, 1)));
+}
+
+/* Module entry point */
+void janet_lib_set(JanetTable *env) {
+    JanetRegExt set_cfuns[] = {
+        JANET_CORE_REG("set/new", cfun_set_new),
+        JANET_CORE_REG("set/frozen", cfun_set_frozen),
+        JANET_CORE_REG("set/freeze", cfun_set_freeze),
+        JANET_CORE_REG("set/add", cfun_set_add),
+        JANET_CORE_REG("set/remove", cfun_set_remove),
+        JANET_CORE_REG("set/union", cfun_set_union),
+        JANET_CORE_REG("set/intersection", cfun_set_intersection),
+        JANET_CORE_REG("set/difference", cfun_set_difference),
+        JANET_CORE_REG("set/subset?", cfun_set_subset),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, set_cfuns);
+    janet_register_abstract_type(&janet_set_type);
+    janet_register_abstract_type(&janet_frozenset_type);
+}
@@ -449,6 +449,128 @@ static JanetSlot janetc_if(JanetFopts opts, int32_t argn, const Janet *argv) {
     return target;
 }
 
+/* Check if a constant can be a jump table key. Keys must hash consistently
+ * with =, and be valid struct keys, so nil and NaN are not allowed. */
+static int janetc_jumptable_key(Janet x) {
+    switch (janet_type(x)) {
+        default:
+            return 0;
+        case JANET_BOOLEAN:
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD:
+            return 1;
+        case JANET_NUMBER: {
+            double d = janet_unwrap_number(x);
+            return d == d;
+        }
+    }
+}
+
+/*
+ * :jumptable
+ * jmptab dispatch table (falls through on a miss)
+ * default
+ * jump done (only if not tail)
+ * :case1
+ * body1
+ * jump done (only if not tail)
+ * ...
+ * :caseN
+ * bodyN
+ * :done
+ *
+ * The table is a constant struct mapping each key to the
+ * jump offset of its body. Earlier keys take precedence.
+ */
+static JanetSlot janetc_jumptable(JanetFopts opts, int32_t argn, const Janet *argv) {
+    JanetCompiler *c = opts.compiler;
+    int32_t i, npairs, labeltab, labeld;
+    int32_t *labels = NULL;
+    int32_t *jumps = NULL;
+    Janet *keys = NULL;
+    JanetSlot dispatch, body, target;
+    JanetScope dispatchscope, tempscope;
+    const int tail = opts.flags & JANET_FOPTS_TAIL;
+    const int drop = opts.flags & JANET_FOPTS_DROP;
+
+    if (argn < 1) {
+        janetc_cerror(c, "expected at least 1 argument to jumptable");
+        return janetc_cslot(janet_wrap_nil());
+    }
+    npairs = (argn - 1) / 2;
+
+    /* Set target for compilation */
+    target = (drop || tail)
+             ? janetc_cslot(janet_wrap_nil())
+             : janetc_gettarget(opts);
+
+    /* Compile dispatch value */
+    janetc_scope(&dispatchscope, c, 0, "jumptable");
+    dispatch = janetc_value(janetc_fopts_default(c), argv[0]);
+
+    /* Keys must all be constants */
+    for (i = 0; i < npairs; i++) {
+        JanetSlot key = janetc_value(janetc_fopts_default(c), argv[1 + 2 * i]);
+        if (!(key.flags & JANET_SLOT_CONSTANT) || !janetc_jumptable_key(key.constant)) {
+            janetc_error(c, janet_formatc("invalid jumptable key %v", argv[1 + 2 * i]));
+            janet_v_free(keys);
+            janetc_popscope(c);
+            return janetc_cslot(janet_wrap_nil());
+        }
+        janet_v_push(keys, key.constant);
+    }
+
+    /* Emit table lookup, constant is filled in once offsets are known */
+    labeltab = janetc_emit_su(c, JOP_JUMP_TABLE, dispatch, 0, 0);
+
+    /* Default body */
+    janetc_scope(&tempscope, c, 0, "jumptable-default");
+    body = janetc_value(opts, (argn & 1) ? janet_wrap_nil() : argv[argn - 1]);
+    if (!drop && !tail) janetc_copy(c, target, body);
+    janetc_popscope(c);
+    if (!tail && npairs) {
+        janet_v_push(jumps, janet_v_count(c->buffer));
+        janetc_emit(c, JOP_JUMP);
+    }
+
+    /* Case bodies */
+    for (i = 0; i < npairs; i++) {
+        janet_v_push(labels, janet_v_count(c->buffer));
+        janetc_scope(&tempscope, c, 0, "jumptable-case");
+        body = janetc_value(opts, argv[2 + 2 * i]);
+        if (!drop && !tail) janetc_copy(c, target, body);
+        janetc_popscope(c);
+        if (!tail && i != npairs - 1) {
+            janet_v_push(jumps, janet_v_count(c->buffer));
+            janetc_emit(c, JOP_JUMP);
+        }
+    }
+
+    janetc_popscope(c);
+
+    /* Write jumps */
+    labeld = janet_v_count(c->buffer);
+    for (i = 0; i < janet_v_count(jumps); i++) {
+        c->buffer[jumps[i]] |= (labeld - jumps[i]) << 8;
+    }
+
+    /* Build the table in reverse so earlier keys win */
+    JanetKV *st = janet_struct_begin(npairs);
+    for (i = npairs - 1; i >= 0; i--) {
+        janet_struct_put(st, keys[i], janet_wrap_integer(labels[i] - labeltab));
+    }
+    int32_t cindex = janetc_const(c, janet_wrap_struct(janet_struct_end(st)));
+    c->buffer[labeltab] |= (uint32_t) cindex << 16;
+
+    janet_v_free(keys);
+    janet_v_free(labels);
+    janet_v_free(jumps);
+
+    if (tail) target.flags |= JANET_SLOT_RETURNED;
+    return target;
+}
+
 /* Compile a do form. Do forms execute their body sequentially and
  * evaluate to the last expression in the body. */
 static JanetSlot janetc_do(JanetFopts opts, int32_t argn, const Janet *argv) {
@@ -674,6 +796,7 @@ static JanetSlot janetc_while(JanetFopts opts, int32_t argn, const Janet *argv)
         /* Compile function */
         JanetFuncDef *def = janetc_pop_funcdef(c);
         def->name = janet_cstring("_while");
+        janetc_regalloc_liveness(def);
         janet_def_addflags(def);
         int32_t defindex = janetc_addfuncdef(c, def);
         /* And then load the closure and call it. */
@@ -849,6 +972,7 @@ static JanetSlot janetc_fn(JanetFopts opts, int32_t argn, const Janet *argv) {
     if (structarg) def->flags |= JANET_FUNCDEF_FLAG_STRUCTARG;
 
     if (selfref) def->name = janet_unwrap_symbol(head);
+    janetc_regalloc_liveness(def);
     janet_def_addflags(def);
     defindex = janetc_addfuncdef(c, def);
 
@@ -874,6 +998,7 @@ static const JanetSpecial janetc_specials[] = {
     {"do", janetc_do},
     {"fn", janetc_fn},
     {"if", janetc_if},
+    {"jumptable", janetc_jumptable},
     {"quasiquote", janetc_quasiquote},
     {"quote", janetc_quote},
     {"set", janetc_varset},
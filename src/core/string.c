@@ -34,14 +34,15 @@
 uint8_t *janet_string_begin(int32_t length) {
     JanetStringHead *head = janet_gcalloc(JANET_MEMORY_STRING, sizeof(JanetStringHead) + (size_t) length + 1);
     head->length = length;
+    head->hash = 0;
     uint8_t *data = (uint8_t *)head->data;
     data[length] = 0;
     return data;
 }
 
-/* Finish building a string */
+/* Finish building a string. The hash is computed lazily
+ * by janet_string_gethash, as most strings are never hashed. */
 const uint8_t *janet_string_end(uint8_t *str) {
-    janet_string_hash(str) = janet_string_calchash(str, janet_string_length(str));
     return str;
 }
 
@@ -49,7 +50,7 @@ const uint8_t *janet_string_end(uint8_t *str) {
 const uint8_t *janet_string(const uint8_t *buf, int32_t len) {
     JanetStringHead *head = janet_gcalloc(JANET_MEMORY_STRING, sizeof(JanetStringHead) + (size_t) len + 1);
     head->length = len;
-    head->hash = janet_string_calchash(buf, len);
+    head->hash = 0;
     uint8_t *data = (uint8_t *)head->data;
     safe_memcpy(data, buf, len);
     data[len] = 0;
@@ -67,13 +68,21 @@ int janet_string_compare(const uint8_t *lhs, const uint8_t *rhs) {
     return xlen < ylen ? -1 : 1;
 }
 
-/* Compare a janet string with a piece of memory */
+/* Get the hash of a string, computing it on first use */
+int32_t janet_string_gethash(const uint8_t *str) {
+    JanetStringHead *head = janet_string_head(str);
+    if (!head->hash) head->hash = janet_string_calchash(str, head->length);
+    return head->hash;
+}
+
+/* Compare a janet string with a piece of memory. A hash of 0
+ * means the hash is not known. */
 int janet_string_equalconst(const uint8_t *lhs, const uint8_t *rhs, int32_t rlen, int32_t rhash) {
-    int32_t lhash = janet_string_hash(lhs);
+    int32_t lhash = janet_string_head(lhs)->hash;
     int32_t llen = janet_string_length(lhs);
     if (lhs == rhs)
         return 1;
-    if (lhash != rhash || llen != rlen)
+    if (llen != rlen || (lhash && rhash && lhash != rhash))
         return 0;
     return !memcmp(lhs, rhs, rlen);
 }
@@ -81,7 +90,7 @@ int janet_string_equalconst(const uint8_t *lhs, const uint8_t *rhs, int32_t rlen
 /* Check if two strings are equal */
 int janet_string_equal(const uint8_t *lhs, const uint8_t *rhs) {
     return janet_string_equalconst(lhs, rhs,
-                                   janet_string_length(rhs), janet_string_hash(rhs));
+                                   janet_string_length(rhs), janet_string_head(rhs)->hash);
 }
 
 /* Load a c string */
@@ -89,36 +98,62 @@ const uint8_t *janet_cstring(const char *str) {
     return janet_string((const uint8_t *)str, (int32_t)strlen(str));
 }
 
-/* Knuth Morris Pratt Algorithm */
+/* Substring search. Candidate positions are found by comparing the first
+ * and last bytes of the pattern against 16 positions of the text at a time
+ * (with SSE2, or memchr without it), and checked with memcmp. Repetitive
+ * text can make most candidates fail late, so once checking has compared
+ * more bytes than a few passes over the text, the search switches to KMP,
+ * which never looks at a byte twice. */
+
+/* Bytes checked per byte of text before switching to KMP */
+#define JANET_FIND_BUDGET 4
 
-struct kmp_state {
+struct find_state {
     int32_t i;
     int32_t j;
     int32_t textlen;
     int32_t patlen;
+    int64_t budget;
     int32_t *lookup;
     const uint8_t *text;
     const uint8_t *pat;
 };
 
-static void kmp_init(
-    struct kmp_state *s,
+static void find_init(
+    struct find_state *s,
     const uint8_t *text, int32_t textlen,
     const uint8_t *pat, int32_t patlen) {
     if (patlen == 0) {
         janet_panic("expected non-empty pattern");
     }
-    int32_t *lookup = janet_calloc(patlen, sizeof(int32_t));
-    if (!lookup) {
-        JANET_OUT_OF_MEMORY;
-    }
-    s->lookup = lookup;
+    s->lookup = NULL;
     s->i = 0;
     s->j = 0;
     s->text = text;
     s->pat = pat;
     s->textlen = textlen;
     s->patlen = patlen;
+    s->budget = JANET_FIND_BUDGET * (int64_t) textlen + 256;
+}
+
+static void find_deinit(struct find_state *state) {
+    janet_free(state->lookup);
+}
+
+static void find_seti(struct find_state *state, int32_t i) {
+    state->i = i;
+    state->j = 0;
+}
+
+static void kmp_init(struct find_state *s) {
+    const uint8_t *pat = s->pat;
+    int32_t patlen = s->patlen;
+    int32_t *lookup = janet_calloc(patlen, sizeof(int32_t));
+    if (!lookup) {
+        JANET_OUT_OF_MEMORY;
+    }
+    s->lookup = lookup;
+    s->j = 0;
     /* Init state machine */
     {
         int32_t i, j;
@@ -130,16 +165,7 @@ static void kmp_init(
     }
 }
 
-static void kmp_deinit(struct kmp_state *state) {
-    janet_free(state->lookup);
-}
-
-static void kmp_seti(struct kmp_state *state, int32_t i) {
-    state->i = i;
-    state->j = 0;
-}
-
-static int32_t kmp_next(struct kmp_state *state) {
+static int32_t kmp_next(struct find_state *state) {
     int32_t i = state->i;
     int32_t j = state->j;
     int32_t textlen = state->textlen;
@@ -168,6 +194,197 @@ static int32_t kmp_next(struct kmp_state *state) {
     return -1;
 }
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define find_first_bit(mask) __builtin_ctz(mask)
+#else
+static int find_first_bit(uint32_t mask) {
+    int ret = 0;
+    while (!(mask & 1)) {
+        ret++;
+        mask >>= 1;
+    }
+    return ret;
+}
+#endif
+
+/* Check a candidate whose first and last bytes match. Returns 1 for a
+ * match, 0 for a miss and -1 if the budget has run out. */
+static int find_check(struct find_state *s, int32_t i) {
+    if (s->patlen <= 2) return 1;
+    s->budget -= s->patlen;
+    if (s->budget < 0) return -1;
+    return !memcmp(s->text + i + 1, s->pat + 1, (size_t) s->patlen - 2);
+}
+
+/* Find the next match with candidate filtering. Returns the position, -1 if
+ * there is none, or -2 with state->i at the position to resume from if the
+ * search should switch to KMP. */
+static int32_t find_fast(struct find_state *s) {
+    const uint8_t *text = s->text;
+    int32_t m = s->patlen;
+    uint8_t first = s->pat[0];
+    uint8_t final = s->pat[m - 1];
+    int32_t last = s->textlen - m;
+    int32_t i = s->i;
+    int check;
+#ifdef __SSE2__
+    __m128i vfirst = _mm_set1_epi8((char) first);
+    __m128i vfinal = _mm_set1_epi8((char) final);
+    for (; i + 15 <= last; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(text + i + m - 1));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(
+                            _mm_and_si128(_mm_cmpeq_epi8(a, vfirst), _mm_cmpeq_epi8(b, vfinal)));
+        while (mask) {
+            int32_t pos = i + find_first_bit(mask);
+            if ((check = find_check(s, pos))) {
+                s->i = pos;
+                return check > 0 ? pos : -2;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i <= last) {
+        const uint8_t *hit = memchr(text + i, first, (size_t)(last - i + 1));
+        if (hit == NULL) break;
+        i = (int32_t)(hit - text);
+        if (text[i + m - 1] == final && (check = find_check(s, i))) {
+            s->i = i;
+            return check > 0 ? i : -2;
+        }
+        i++;
+    }
+    return -1;
+}
+
+/* Find the next match at or after state->i, including matches that overlap
+ * the previous one. Returns -1 if there are no more matches. */
+static int32_t find_next(struct find_state *state) {
+    if (state->lookup == NULL) {
+        int32_t result = find_fast(state);
+        if (result != -2) {
+            if (result >= 0) state->i = result + 1;
+            return result;
+        }
+        kmp_init(state);
+    }
+    return kmp_next(state);
+}
+
+/* Byte classes. A byte set is a 256 bit map, plus its members when there
+ * are few enough to compare against 16 bytes at a time with SSE2, which
+ * covers the usual sets like whitespace. Spans report how many bytes at
+ * the start or end of some text are in the set. */
+
+#define JANET_BYTESET_VECTOR 8
+
+typedef struct {
+    uint32_t bits[8];
+    int32_t count;
+    uint8_t members[JANET_BYTESET_VECTOR];
+} JanetByteSet;
+
+#ifdef __GNUC__
+#define find_last_bit(mask) (31 - __builtin_clz(mask))
+#else
+static int find_last_bit(uint32_t mask) {
+    int ret = 31;
+    while (!(mask & 0x80000000u)) {
+        ret--;
+        mask <<= 1;
+    }
+    return ret;
+}
+#endif
+
+static void byteset_init(JanetByteSet *set, JanetByteView bytes) {
+    memset(set->bits, 0, sizeof(set->bits));
+    set->count = 0;
+    for (int32_t i = 0; i < bytes.len; i++) {
+        uint8_t c = bytes.bytes[i];
+        uint32_t mask = 1u << (c & 0x1F);
+        if (set->bits[c >> 5] & mask) continue;
+        set->bits[c >> 5] |= mask;
+        if (set->count >= 0 && set->count < JANET_BYTESET_VECTOR) {
+            set->members[set->count++] = c;
+        } else {
+            set->count = -1;
+        }
+    }
+}
+
+static int byteset_has(const JanetByteSet *set, uint8_t c) {
+    return (set->bits[c >> 5] >> (c & 0x1F)) & 1;
+}
+
+#ifdef __SSE2__
+/* Bitmask of the 16 bytes at p that are in a set of few members */
+static uint32_t byteset_match16(const JanetByteSet *set, const uint8_t *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i in = _mm_setzero_si128();
+    for (int32_t k = 0; k < set->count; k++) {
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) set->members[k])));
+    }
+    return (uint32_t) _mm_movemask_epi8(in);
+}
+#endif
+
+/* Number of bytes at the start of text that are in the set */
+static int32_t byteset_span(const JanetByteSet *set, const uint8_t *text, int32_t len) {
+    int32_t i = 0;
+#ifdef __SSE2__
+    if (set->count >= 0) {
+        for (; i + 16 <= len; i += 16) {
+            uint32_t out = ~byteset_match16(set, text + i) & 0xFFFF;
+            if (out) return i + find_first_bit(out);
+        }
+    }
+#endif
+    while (i < len && byteset_has(set, text[i])) i++;
+    return i;
+}
+
+/* Number of bytes at the end of text that are in the set */
+static int32_t byteset_rspan(const JanetByteSet *set, const uint8_t *text, int32_t len) {
+    int32_t i = len;
+#ifdef __SSE2__
+    if (set->count >= 0) {
+        for (; i >= 16; i -= 16) {
+            uint32_t out = ~byteset_match16(set, text + i - 16) & 0xFFFF;
+            if (out) return len - (i - 16 + find_last_bit(out) + 1);
+        }
+    }
+#endif
+    while (i > 0 && byteset_has(set, text[i - 1])) i--;
+    return len - i;
+}
+
+/* Copy text to dest, flipping the case of the 26 bytes from first. Letters
+ * differ from the other case only in bit 0x20. */
+static void ascii_flip_range(uint8_t *dest, const uint8_t *text, int32_t len, uint8_t first) {
+    int32_t i = 0;
+#ifdef __SSE2__
+    /* Shift the range to the bottom of the signed bytes for one compare */
+    __m128i shift = _mm_set1_epi8((char)(0x80 - first));
+    __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+    __m128i flip = _mm_set1_epi8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i in = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(v, _mm_and_si128(in, flip)));
+    }
+#endif
+    for (; i < len; i++) {
+        uint8_t c = text[i];
+        dest[i] = c ^ (uint8_t)(((uint8_t)(c - first) < 26) << 5);
+    }
+}
+
 /* CFuns */
 
 JANET_CORE_FN(cfun_string_slice,
@@ -250,14 +467,7 @@ JANET_CORE_FN(cfun_string_asciilower,
     janet_fixarity(argc, 1);
     JanetByteView view = janet_getbytes(argv, 0);
     uint8_t *buf = janet_string_begin(view.len);
-    for (int32_t i = 0; i < view.len; i++) {
-        uint8_t c = view.bytes[i];
-        if (c >= 65 && c <= 90) {
-            buf[i] = c + 32;
-        } else {
-            buf[i] = c;
-        }
-    }
+    ascii_flip_range(buf, view.bytes, view.len, 'A');
     return janet_wrap_string(janet_string_end(buf));
 }
 
@@ -269,14 +479,7 @@ JANET_CORE_FN(cfun_string_asciiupper,
     janet_fixarity(argc, 1);
     JanetByteView view = janet_getbytes(argv, 0);
     uint8_t *buf = janet_string_begin(view.len);
-    for (int32_t i = 0; i < view.len; i++) {
-        uint8_t c = view.bytes[i];
-        if (c >= 97 && c <= 122) {
-            buf[i] = c - 32;
-        } else {
-            buf[i] = c;
-        }
-    }
+    ascii_flip_range(buf, view.bytes, view.len, 'a');
     return janet_wrap_string(janet_string_end(buf));
 }
 
@@ -293,7 +496,7 @@ JANET_CORE_FN(cfun_string_reverse,
     return janet_wrap_string(janet_string_end(buf));
 }
 
-static void findsetup(int32_t argc, Janet *argv, struct kmp_state *s, int32_t extra) {
+static void findsetup(int32_t argc, Janet *argv, struct find_state *s, int32_t extra) {
     janet_arity(argc, 2, 3 + extra);
     JanetByteView pat = janet_getbytes(argv, 0);
     JanetByteView text = janet_getbytes(argv, 1);
@@ -302,7 +505,7 @@ static void findsetup(int32_t argc, Janet *argv, struct kmp_state *s, int32_t ex
         start = janet_getinteger(argv, 2);
         if (start < 0) janet_panic("expected non-negative start index");
     }
-    kmp_init(s, text.bytes, text.len, pat.bytes, pat.len);
+    find_init(s, text.bytes, text.len, pat.bytes, pat.len);
     s->i = start;
 }
 
@@ -312,10 +515,10 @@ JANET_CORE_FN(cfun_string_find,
               "str. Returns the index of the first character in patt if found, "
               "otherwise returns nil.") {
     int32_t result;
-    struct kmp_state state;
+    struct find_state state;
     findsetup(argc, argv, &state, 0);
-    result = kmp_next(&state);
-    kmp_deinit(&state);
+    result = find_next(&state);
+    find_deinit(&state);
     return result < 0
            ? janet_wrap_nil()
            : janet_wrap_integer(result);
@@ -352,18 +555,18 @@ JANET_CORE_FN(cfun_string_findall,
               "instances of the pattern are counted individually, meaning a byte in str "
               "may contribute to multiple found patterns.") {
     int32_t result;
-    struct kmp_state state;
+    struct find_state state;
     findsetup(argc, argv, &state, 0);
     JanetArray *array = janet_array(0);
-    while ((result = kmp_next(&state)) >= 0) {
+    while ((result = find_next(&state)) >= 0) {
         janet_array_push(array, janet_wrap_integer(result));
     }
-    kmp_deinit(&state);
+    find_deinit(&state);
     return janet_wrap_array(array);
 }
 
 struct replace_state {
-    struct kmp_state kmp;
+    struct find_state find;
     const uint8_t *subst;
     int32_t substlen;
 };
@@ -378,8 +581,8 @@ static void replacesetup(int32_t argc, Janet *argv, struct replace_state *s) {
         start = janet_getinteger(argv, 3);
         if (start < 0) janet_panic("expected non-negative start index");
     }
-    kmp_init(&s->kmp, text.bytes, text.len, pat.bytes, pat.len);
-    s->kmp.i = start;
+    find_init(&s->find, text.bytes, text.len, pat.bytes, pat.len);
+    s->find.i = start;
     s->subst = subst.bytes;
     s->substlen = subst.len;
 }
@@ -392,18 +595,18 @@ JANET_CORE_FN(cfun_string_replace,
     struct replace_state s;
     uint8_t *buf;
     replacesetup(argc, argv, &s);
-    result = kmp_next(&s.kmp);
+    result = find_next(&s.find);
     if (result < 0) {
-        kmp_deinit(&s.kmp);
-        return janet_stringv(s.kmp.text, s.kmp.textlen);
+        find_deinit(&s.find);
+        return janet_stringv(s.find.text, s.find.textlen);
     }
-    buf = janet_string_begin(s.kmp.textlen - s.kmp.patlen + s.substlen);
-    safe_memcpy(buf, s.kmp.text, result);
+    buf = janet_string_begin(s.find.textlen - s.find.patlen + s.substlen);
+    safe_memcpy(buf, s.find.text, result);
     safe_memcpy(buf + result, s.subst, s.substlen);
     safe_memcpy(buf + result + s.substlen,
-                s.kmp.text + result + s.kmp.patlen,
-                s.kmp.textlen - result - s.kmp.patlen);
-    kmp_deinit(&s.kmp);
+                s.find.text + result + s.find.patlen,
+                s.find.textlen - result - s.find.patlen);
+    find_deinit(&s.find);
     return janet_wrap_string(janet_string_end(buf));
 }
 
@@ -417,17 +620,17 @@ JANET_CORE_FN(cfun_string_replaceall,
     JanetBuffer b;
     int32_t lastindex = 0;
     replacesetup(argc, argv, &s);
-    janet_buffer_init(&b, s.kmp.textlen);
-    while ((result = kmp_next(&s.kmp)) >= 0) {
-        janet_buffer_push_bytes(&b, s.kmp.text + lastindex, result - lastindex);
+    janet_buffer_init(&b, s.find.textlen);
+    while ((result = find_next(&s.find)) >= 0) {
+        janet_buffer_push_bytes(&b, s.find.text + lastindex, result - lastindex);
         janet_buffer_push_bytes(&b, s.subst, s.substlen);
-        lastindex = result + s.kmp.patlen;
-        kmp_seti(&s.kmp, lastindex);
+        lastindex = result + s.find.patlen;
+        find_seti(&s.find, lastindex);
     }
-    janet_buffer_push_bytes(&b, s.kmp.text + lastindex, s.kmp.textlen - lastindex);
+    janet_buffer_push_bytes(&b, s.find.text + lastindex, s.find.textlen - lastindex);
     const uint8_t *ret = janet_string(b.data, b.count);
     janet_buffer_deinit(&b);
-    kmp_deinit(&s.kmp);
+    find_deinit(&s.find);
     return janet_wrap_string(ret);
 }
 
@@ -440,22 +643,22 @@ JANET_CORE_FN(cfun_string_split,
               "of limit results (if provided).") {
     int32_t result;
     JanetArray *array;
-    struct kmp_state state;
+    struct find_state state;
     int32_t limit = -1, lastindex = 0;
     if (argc == 4) {
         limit = janet_getinteger(argv, 3);
     }
     findsetup(argc, argv, &state, 1);
     array = janet_array(0);
-    while ((result = kmp_next(&state)) >= 0 && --limit) {
+    while ((result = find_next(&state)) >= 0 && --limit) {
         const uint8_t *slice = janet_string(state.text + lastindex, result - lastindex);
         janet_array_push(array, janet_wrap_string(slice));
         lastindex = result + state.patlen;
-        kmp_seti(&state, lastindex);
+        find_seti(&state, lastindex);
     }
     const uint8_t *slice = janet_string(state.text + lastindex, state.textlen - lastindex);
     janet_array_push(array, janet_wrap_string(slice));
-    kmp_deinit(&state);
+    find_deinit(&state);
     return janet_wrap_array(array);
 }
 
@@ -464,25 +667,11 @@ JANET_CORE_FN(cfun_string_checkset,
               "Checks that the string str only contains bytes that appear in the string set. "
               "Returns true if all bytes in str appear in set, false if some bytes in str do "
               "not appear in set.") {
-    uint32_t bitset[8] = {0, 0, 0, 0, 0, 0, 0, 0};
     janet_fixarity(argc, 2);
-    JanetByteView set = janet_getbytes(argv, 0);
+    JanetByteSet set;
+    byteset_init(&set, janet_getbytes(argv, 0));
     JanetByteView str = janet_getbytes(argv, 1);
-    /* Populate set */
-    for (int32_t i = 0; i < set.len; i++) {
-        int index = set.bytes[i] >> 5;
-        uint32_t mask = 1 << (set.bytes[i] & 0x1F);
-        bitset[index] |= mask;
-    }
-    /* Check set */
-    for (int32_t i = 0; i < str.len; i++) {
-        int index = str.bytes[i] >> 5;
-        uint32_t mask = 1 << (str.bytes[i] & 0x1F);
-        if (!(bitset[index] & mask)) {
-            return janet_wrap_false();
-        }
-    }
-    return janet_wrap_true();
+    return janet_wrap_boolean(byteset_span(&set, str.bytes, str.len) == str.len);
 }
 
 JANET_CORE_FN(cfun_string_join,
@@ -534,53 +723,35 @@ JANET_CORE_FN(cfun_string_format,
               "a new string.") {
     janet_arity(argc, 1, -1);
     JanetBuffer *buffer = janet_buffer(0);
-    const char *strfrmt = (const char *) janet_getstring(argv, 0);
-    janet_buffer_format(buffer, strfrmt, 0, argc, argv);
+    Janet format = janet_getformat(argv, 0);
+    janet_buffer_format_value(buffer, format, 0, argc, argv);
     return janet_stringv(buffer->data, buffer->count);
 }
 
-static int trim_help_checkset(JanetByteView set, uint8_t x) {
-    for (int32_t j = 0; j < set.len; j++)
-        if (set.bytes[j] == x)
-            return 1;
-    return 0;
-}
-
-static int32_t trim_help_leftedge(JanetByteView str, JanetByteView set) {
-    for (int32_t i = 0; i < str.len; i++)
-        if (!trim_help_checkset(set, str.bytes[i]))
-            return i;
-    return str.len;
-}
-
-static int32_t trim_help_rightedge(JanetByteView str, JanetByteView set) {
-    for (int32_t i = str.len - 1; i >= 0; i--)
-        if (!trim_help_checkset(set, str.bytes[i]))
-            return i + 1;
-    return 0;
-}
-
-static void trim_help_args(int32_t argc, Janet *argv, JanetByteView *str, JanetByteView *set) {
+static void trim_help_args(int32_t argc, Janet *argv, JanetByteView *str, JanetByteSet *set) {
     janet_arity(argc, 1, 2);
     *str = janet_getbytes(argv, 0);
+    JanetByteView members;
     if (argc >= 2) {
-        *set = janet_getbytes(argv, 1);
+        members = janet_getbytes(argv, 1);
     } else {
-        set->bytes = (const uint8_t *)(" \t\r\n\v\f");
-        set->len = 6;
+        members.bytes = (const uint8_t *)(" \t\r\n\v\f");
+        members.len = 6;
     }
+    byteset_init(set, members);
 }
 
 JANET_CORE_FN(cfun_string_trim,
               "(string/trim str &opt set)",
               "Trim leading and trailing whitespace from a byte sequence. If the argument "
               "set is provided, consider only characters in set to be whitespace.") {
-    JanetByteView str, set;
+    JanetByteView str;
+    JanetByteSet set;
     trim_help_args(argc, argv, &str, &set);
-    int32_t left_edge = trim_help_leftedge(str, set);
-    int32_t right_edge = trim_help_rightedge(str, set);
-    if (right_edge < left_edge)
+    int32_t left_edge = byteset_span(&set, str.bytes, str.len);
+    if (left_edge == str.len)
         return janet_stringv(NULL, 0);
+    int32_t right_edge = str.len - byteset_rspan(&set, str.bytes, str.len);
     return janet_stringv(str.bytes + left_edge, right_edge - left_edge);
 }
 
@@ -588,9 +759,10 @@ JANET_CORE_FN(cfun_string_triml,
               "(string/triml str &opt set)",
               "Trim leading whitespace from a byte sequence. If the argument "
               "set is provided, consider only characters in set to be whitespace.") {
-    JanetByteView str, set;
+    JanetByteView str;
+    JanetByteSet set;
     trim_help_args(argc, argv, &str, &set);
-    int32_t left_edge = trim_help_leftedge(str, set);
+    int32_t left_edge = byteset_span(&set, str.bytes, str.len);
     return janet_stringv(str.bytes + left_edge, str.len - left_edge);
 }
 
@@ -598,9 +770,10 @@ JANET_CORE_FN(cfun_string_trimr,
               "(string/trimr str &opt set)",
               "Trim trailing whitespace from a byte sequence. If the argument "
               "set is provided, consider only characters in set to be whitespace.") {
-    JanetByteView str, set;
+    JanetByteView str;
+    JanetByteSet set;
     trim_help_args(argc, argv, &str, &set);
-    int32_t right_edge = trim_help_rightedge(str, set);
+    int32_t right_edge = str.len - byteset_rspan(&set, str.bytes, str.len);
     return janet_stringv(str.bytes, right_edge);
 }
 
@@ -632,4 +805,5 @@ void janet_lib_string(JanetTable *env) {
         JANET_REG_END
     };
     janet_core_cfuns_ext(env, NULL, string_cfuns);
+    janet_register_abstract_type(&janet_format_type);
 }
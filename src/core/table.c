@@ -30,33 +30,168 @@
 
 #define JANET_TABLE_FLAG_STACK 0x10000
 
-static void *janet_memalloc_empty_local(int32_t count) {
-    int32_t i;
-    void *mem = janet_smalloc((size_t) count * sizeof(JanetKV));
-    JanetKV *mmem = (JanetKV *)mem;
-    for (i = 0; i < count; i++) {
-        JanetKV *kv = mmem + i;
-        kv->key = janet_wrap_nil();
-        kv->value = janet_wrap_nil();
+/* A table stores its entries densely, in insertion order, in the first
+ * count + deleted buckets of data. Removed entries leave a tombstone (nil key,
+ * and the removed key as value) so iteration can continue past them. Removing
+ * keys compacts the table once tombstones outnumber entries, so they never
+ * keep many removed keys alive. After the capacity buckets, the same
+ * allocation holds the hash index: one int32 entry number per slot, and then
+ * one control byte per slot. A control byte is either empty, deleted, or 7
+ * bits of the hash of the key in the slot. Lookups scan the control bytes a
+ * group at a time and only compare keys whose tag matches. The first
+ * JANET_TABLE_GROUP control bytes are mirrored past the end so a group never
+ * needs to wrap around. The index has a power of two number of slots, and
+ * capacity is three quarters of that. */
+#define JANET_TABLE_GROUP 16
+#define JANET_TABLE_MINSLOTS 4
+#define JANET_TABLE_SHRINK_MIN 48
+#define JANET_CTRL_EMPTY 0x80
+#define JANET_CTRL_DELETED 0xFE
+
+#define janet_table_slots(cap) ((cap) + (cap) / 3)
+#define janet_table_index(data, cap) ((int32_t *)((data) + (cap)))
+#define janet_table_ctrl(data, cap) ((uint8_t *)(janet_table_index(data, cap) + janet_table_slots(cap)))
+#define janet_table_used(t) ((t)->count + (t)->deleted)
+
+static uint8_t janet_table_tag(int32_t hash) {
+    return (uint8_t)(((uint32_t) hash * 0x9E3779B1u) >> 25);
+}
+
+/* Number of index slots needed to hold capacity entries */
+static int32_t janet_table_slotsfor(int32_t capacity) {
+    if (capacity <= 0) return 0;
+    int64_t needed = ((int64_t) capacity * 4 + 2) / 3;
+    if (needed > INT32_MAX / 2) {
+        JANET_OUT_OF_MEMORY;
     }
-    return mem;
+    int32_t slots = janet_tablen((int32_t) needed - 1);
+    return slots < JANET_TABLE_MINSLOTS ? JANET_TABLE_MINSLOTS : slots;
 }
 
-static JanetTable *janet_table_init_impl(JanetTable *table, int32_t capacity, int stackalloc) {
+static size_t janet_table_datasize(int32_t capacity) {
+    size_t slots = (size_t) janet_table_slots(capacity);
+    return (size_t) capacity * sizeof(JanetKV) + slots * sizeof(int32_t) + slots + JANET_TABLE_GROUP;
+}
+
+/* Allocate buckets and an empty index for a table with the given number of
+ * index slots. Returns the buckets and sets *capacity. */
+static JanetKV *janet_table_data_alloc(int32_t slots, int32_t *capacity, int stackalloc) {
+    int32_t cap = slots - slots / 4;
+    size_t size = janet_table_datasize(cap);
     JanetKV *data;
-    capacity = janet_tablen(capacity);
-    if (stackalloc) table->gc.flags = JANET_TABLE_FLAG_STACK;
-    if (capacity) {
-        if (stackalloc) {
-            data = janet_memalloc_empty_local(capacity);
-        } else {
-            data = (JanetKV *) janet_memalloc_empty(capacity);
-            if (NULL == data) {
-                JANET_OUT_OF_MEMORY;
+    if (stackalloc) {
+        data = janet_smalloc(size);
+    } else {
+        data = janet_malloc(size);
+        if (NULL == data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_vm.next_collection += size;
+    }
+    for (int32_t i = 0; i < cap; i++) {
+        data[i].key = janet_wrap_nil();
+        data[i].value = janet_wrap_nil();
+    }
+    memset(janet_table_ctrl(data, cap), JANET_CTRL_EMPTY, (size_t) slots + JANET_TABLE_GROUP);
+    *capacity = cap;
+    return data;
+}
+
+/* Point an index slot at an entry */
+static void janet_table_setslot(JanetTable *t, int32_t slot, int32_t entry, uint8_t c) {
+    int32_t slots = janet_table_slots(t->capacity);
+    uint8_t *ctrl = janet_table_ctrl(t->data, t->capacity);
+    janet_table_index(t->data, t->capacity)[slot] = entry;
+    ctrl[slot] = c;
+    for (int32_t i = slots + slot; i < slots + JANET_TABLE_GROUP; i += slots) {
+        ctrl[i] = c;
+    }
+}
+
+/* Bitmasks of the control bytes in a group that equal a given byte */
+#ifdef __SSE2__
+#include <emmintrin.h>
+typedef __m128i JanetCtrlGroup;
+#define janet_ctrl_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define janet_ctrl_match(g, c) ((uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8((g), _mm_set1_epi8((char)(c)))))
+#else
+typedef const uint8_t *JanetCtrlGroup;
+#define janet_ctrl_load(p) (p)
+static uint32_t janet_ctrl_match(JanetCtrlGroup g, uint8_t c) {
+    uint32_t mask = 0;
+    for (int i = 0; i < JANET_TABLE_GROUP; i++) {
+        if (g[i] == c) mask |= 1u << i;
+    }
+    return mask;
+}
+#endif
+
+#ifdef __GNUC__
+#define janet_ctrl_first(mask) __builtin_ctz(mask)
+#else
+static int janet_ctrl_first(uint32_t mask) {
+    int ret = 0;
+    while (!(mask & 1)) {
+        ret++;
+        mask >>= 1;
+    }
+    return ret;
+}
+#endif
+
+/* Find the index slot of a key. Returns the slot, or -1 if the key is not in
+ * the table. If free_slot is not NULL and the key is not found, it is set to
+ * the slot a new entry for the key should take. */
+static int32_t janet_table_probe(JanetTable *t, Janet key, int32_t hash, int32_t *free_slot) {
+    int32_t slots = janet_table_slots(t->capacity);
+    if (slots == 0) return -1;
+    const JanetKV *data = t->data;
+    const int32_t *index = janet_table_index(data, t->capacity);
+    const uint8_t *ctrl = janet_table_ctrl(data, t->capacity);
+    uint8_t tag = janet_table_tag(hash);
+    int32_t pos = janet_maphash(slots, hash);
+    int32_t first_deleted = -1;
+    for (int32_t probed = 0; probed < slots; probed += JANET_TABLE_GROUP) {
+        JanetCtrlGroup group = janet_ctrl_load(ctrl + pos);
+        uint32_t match = janet_ctrl_match(group, tag);
+        while (match) {
+            int32_t slot = (pos + janet_ctrl_first(match)) & (slots - 1);
+            if (janet_equals(data[index[slot]].key, key)) return slot;
+            match &= match - 1;
+        }
+        uint32_t empty = janet_ctrl_match(group, JANET_CTRL_EMPTY);
+        if (first_deleted < 0) {
+            /* Only deleted slots before the first empty slot are on the probe path */
+            uint32_t deleted = janet_ctrl_match(group, JANET_CTRL_DELETED);
+            if (empty) deleted &= (empty & (~empty + 1)) - 1;
+            if (deleted) first_deleted = (pos + janet_ctrl_first(deleted)) & (slots - 1);
+        }
+        if (empty) {
+            if (free_slot) {
+                *free_slot = first_deleted >= 0
+                             ? first_deleted
+                             : (pos + janet_ctrl_first(empty)) & (slots - 1);
             }
+            return -1;
         }
-        table->data = data;
-        table->capacity = capacity;
+        pos = (pos + JANET_TABLE_GROUP) & (slots - 1);
+    }
+    if (free_slot) *free_slot = first_deleted;
+    return -1;
+}
+
+/* Get the entry holding a key, or NULL */
+static JanetKV *janet_table_entry(JanetTable *t, Janet key) {
+    int32_t slot = janet_table_probe(t, key, janet_hash(key), NULL);
+    if (slot < 0) return NULL;
+    return t->data + janet_table_index(t->data, t->capacity)[slot];
+}
+
+static JanetTable *janet_table_init_impl(JanetTable *table, int32_t capacity, int stackalloc) {
+    int32_t slots = janet_table_slotsfor(capacity);
+    if (stackalloc) table->gc.flags = JANET_TABLE_FLAG_STACK;
+    if (slots) {
+        table->data = janet_table_data_alloc(slots, &table->capacity, stackalloc);
     } else {
         table->data = NULL;
         table->capacity = 0;
@@ -92,37 +227,70 @@ JanetTable *janet_table(int32_t capacity) {
     return janet_table_init_impl(table, capacity, 0);
 }
 
-/* Find the bucket that contains the given key. Will also return
- * bucket where key should go if not in the table. */
+/* Find the bucket that contains the given key, or NULL if the key is
+ * not in the table. The value of the bucket may be changed in place, but
+ * new keys must be added with janet_table_put so the index sees them. */
+JanetKV *janet_table_lookup(JanetTable *t, Janet key) {
+    return janet_table_entry(t, key);
+}
+
+/* Deprecated. Used to also return the bucket for a missing key. */
 JanetKV *janet_table_find(JanetTable *t, Janet key) {
-    return (JanetKV *) janet_dict_find(t->data, t->capacity, key);
+    return janet_table_entry(t, key);
 }
 
-/* Resize the dictionary table. */
-static void janet_table_rehash(JanetTable *t, int32_t size) {
+/* Rebuild the index from the entries. Live entries go first, because a
+ * probe for a free slot would reuse the deleted slot of a kept tombstone. */
+static void janet_table_reindex(JanetTable *t) {
+    int32_t used = janet_table_used(t);
+    for (int32_t i = 0; i < used; i++) {
+        Janet key = t->data[i].key;
+        if (janet_checktype(key, JANET_NIL)) continue;
+        int32_t hash = janet_hash(key);
+        int32_t slot = -1;
+        janet_table_probe(t, key, hash, &slot);
+        janet_table_setslot(t, slot, i, janet_table_tag(hash));
+    }
+    for (int32_t i = 0; t->deleted && i < used; i++) {
+        if (!janet_checktype(t->data[i].key, JANET_NIL)) continue;
+        Janet key = t->data[i].value;
+        int32_t slot = -1;
+        janet_table_probe(t, key, janet_hash(key), &slot);
+        janet_table_setslot(t, slot, i, JANET_CTRL_DELETED);
+    }
+}
+
+/* Resize the table to a number of index slots, dropping tombstones except
+ * for the entry keep, if it is not -1. If the number of slots does not
+ * change, tombstones are dropped in place. */
+static void janet_table_rehash(JanetTable *t, int32_t slots, int32_t keep) {
     JanetKV *olddata = t->data;
-    JanetKV *newdata;
+    int32_t oldused = janet_table_used(t);
     int islocal = t->gc.flags & JANET_TABLE_FLAG_STACK;
-    if (islocal) {
-        newdata = (JanetKV *) janet_memalloc_empty_local(size);
-    } else {
-        newdata = (JanetKV *) janet_memalloc_empty(size);
-        if (NULL == newdata) {
-            JANET_OUT_OF_MEMORY;
+    if (slots && slots == janet_table_slots(t->capacity)) {
+        int32_t n = 0;
+        for (int32_t i = 0; i < oldused; i++) {
+            if (i == keep || !janet_checktype(olddata[i].key, JANET_NIL)) olddata[n++] = olddata[i];
         }
+        janet_memempty(olddata + n, oldused - n);
+        memset(janet_table_ctrl(olddata, t->capacity), JANET_CTRL_EMPTY, (size_t) slots + JANET_TABLE_GROUP);
+        t->deleted = keep < 0 ? 0 : 1;
+        janet_table_reindex(t);
+        return;
     }
-    int32_t i, oldcapacity;
-    oldcapacity = t->capacity;
-    t->data = newdata;
-    t->capacity = size;
-    t->deleted = 0;
-    for (i = 0; i < oldcapacity; i++) {
-        JanetKV *kv = olddata + i;
-        if (!janet_checktype(kv->key, JANET_NIL)) {
-            JanetKV *newkv = janet_table_find(t, kv->key);
-            *newkv = *kv;
+    if (slots) {
+        t->data = janet_table_data_alloc(slots, &t->capacity, islocal);
+        int32_t n = 0;
+        for (int32_t i = 0; i < oldused; i++) {
+            if (i == keep || !janet_checktype(olddata[i].key, JANET_NIL)) t->data[n++] = olddata[i];
         }
+        t->deleted = keep < 0 ? 0 : 1;
+    } else {
+        t->data = NULL;
+        t->capacity = 0;
+        t->deleted = 0;
     }
+    janet_table_reindex(t);
     if (islocal) {
         janet_sfree(olddata);
     } else {
@@ -130,67 +298,92 @@ static void janet_table_rehash(JanetTable *t, int32_t size) {
     }
 }
 
+/* Drop tombstones and release unused capacity. */
+void janet_table_compact(JanetTable *t) {
+    janet_table_rehash(t, janet_table_slotsfor(t->count), -1);
+}
+
 /* Get a value out of the table */
 Janet janet_table_get(JanetTable *t, Janet key) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
-        return bucket->value;
-    /* Check prototypes */
-    {
-        int i;
-        for (i = JANET_MAX_PROTO_DEPTH, t = t->proto; t && i; t = t->proto, --i) {
-            bucket = janet_table_find(t, key);
-            if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
-                return bucket->value;
-        }
-    }
+    int i = JANET_MAX_PROTO_DEPTH + 1;
+    do {
+        JanetKV *kv = janet_table_entry(t, key);
+        if (NULL != kv) return kv->value;
+        t = t->proto;
+    } while (t && --i);
     return janet_wrap_nil();
 }
 
 /* Get a value out of the table, and record which prototype it was from. */
 Janet janet_table_get_ex(JanetTable *t, Janet key, JanetTable **which) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-        *which = t;
-        return bucket->value;
-    }
-    /* Check prototypes */
-    {
-        int i;
-        for (i = JANET_MAX_PROTO_DEPTH, t = t->proto; t && i; t = t->proto, --i) {
-            bucket = janet_table_find(t, key);
-            if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-                *which = t;
-                return bucket->value;
-            }
+    int i = JANET_MAX_PROTO_DEPTH + 1;
+    do {
+        JanetKV *kv = janet_table_entry(t, key);
+        if (NULL != kv) {
+            *which = t;
+            return kv->value;
         }
-    }
+        t = t->proto;
+    } while (t && --i);
     return janet_wrap_nil();
 }
 
 /* Get a value out of the table. Don't check prototype tables. */
 Janet janet_table_rawget(JanetTable *t, Janet key) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
-        return bucket->value;
-    else
-        return janet_wrap_nil();
+    JanetKV *kv = janet_table_entry(t, key);
+    return NULL != kv ? kv->value : janet_wrap_nil();
 }
 
 /* Remove an entry from the dictionary. Return the value that
  * was removed. */
 Janet janet_table_remove(JanetTable *t, Janet key) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-        Janet ret = bucket->value;
-        t->count--;
-        t->deleted++;
-        bucket->key = janet_wrap_nil();
-        bucket->value = janet_wrap_false();
-        return ret;
-    } else {
-        return janet_wrap_nil();
+    int32_t slot = janet_table_probe(t, key, janet_hash(key), NULL);
+    if (slot < 0) return janet_wrap_nil();
+    int32_t entry = janet_table_index(t->data, t->capacity)[slot];
+    JanetKV *kv = t->data + entry;
+    Janet ret = kv->value;
+    t->count--;
+    t->deleted++;
+    /* The tombstone keeps the removed key so iteration can continue past it */
+    kv->key = janet_wrap_nil();
+    kv->value = key;
+    janet_table_setslot(t, slot, entry, JANET_CTRL_DELETED);
+    if (t->count == 0) {
+        /* Nothing is left to iterate, so drop all tombstones, and
+         * release the memory of large tables */
+        janet_table_rehash(t, t->capacity > JANET_TABLE_SHRINK_MIN ? 0 : janet_table_slots(t->capacity), -1);
+    } else if (t->deleted > t->count && t->deleted >= JANET_TABLE_GROUP) {
+        /* Drop tombstones, and shrink after most entries were removed. Keep
+         * the tombstone of this key in case it is the key being iterated. */
+        int32_t slots = t->capacity > JANET_TABLE_SHRINK_MIN && t->count < t->capacity / 8
+                        ? janet_table_slotsfor(2 * (t->count + 1))
+                        : janet_table_slots(t->capacity);
+        janet_table_rehash(t, slots, entry);
+    }
+    return ret;
+}
+
+/* Find the bucket to continue iteration from after a key. A key that was
+ * removed during iteration is found through its tombstone. Returns NULL if
+ * the key is not in the table. */
+JanetKV *janet_table_find_next(JanetTable *t, Janet key) {
+    int32_t hash = janet_hash(key);
+    int32_t slot = janet_table_probe(t, key, hash, NULL);
+    if (slot >= 0) return t->data + janet_table_index(t->data, t->capacity)[slot];
+    int32_t slots = janet_table_slots(t->capacity);
+    if (slots == 0) return NULL;
+    const int32_t *index = janet_table_index(t->data, t->capacity);
+    const uint8_t *ctrl = janet_table_ctrl(t->data, t->capacity);
+    int32_t pos = janet_maphash(slots, hash);
+    for (int32_t probed = 0; probed < slots; probed++) {
+        if (ctrl[pos] == JANET_CTRL_EMPTY) break;
+        if (ctrl[pos] == JANET_CTRL_DELETED) {
+            JanetKV *kv = t->data + index[pos];
+            if (janet_checktype(kv->key, JANET_NIL) && janet_equals(kv->value, key)) return kv;
+        }
+        pos = (pos + 1) & (slots - 1);
     }
+    return NULL;
 }
 
 /* Put a value into the object */
@@ -199,29 +392,46 @@ void janet_table_put(JanetTable *t, Janet key, Janet value) {
     if (janet_checktype(key, JANET_NUMBER) && isnan(janet_unwrap_number(key))) return;
     if (janet_checktype(value, JANET_NIL)) {
         janet_table_remove(t, key);
-    } else {
-        JanetKV *bucket = janet_table_find(t, key);
-        if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-            bucket->value = value;
-        } else {
-            if (NULL == bucket || 2 * (t->count + t->deleted + 1) > t->capacity) {
-                janet_table_rehash(t, janet_tablen(2 * t->count + 2));
+        return;
+    }
+    int32_t hash = janet_hash(key);
+    int32_t free_slot = -1;
+    int32_t slot = janet_table_probe(t, key, hash, &free_slot);
+    if (slot >= 0) {
+        t->data[janet_table_index(t->data, t->capacity)[slot]].value = value;
+        return;
+    }
+    if (t->deleted && t->capacity > JANET_TABLE_SHRINK_MIN && t->count < t->capacity / 8) {
+        /* Shrink after most entries were removed */
+        janet_table_rehash(t, janet_table_slotsfor(2 * (t->count + 1)), -1);
+        janet_table_probe(t, key, hash, &free_slot);
+    } else if (janet_table_used(t) >= t->capacity) {
+        /* Grow, unless dropping tombstones frees enough room */
+        int32_t slots = janet_table_slots(t->capacity);
+        if (slots == 0) {
+            slots = JANET_TABLE_MINSLOTS;
+        } else if (t->deleted == 0 || t->deleted < t->capacity / 4) {
+            if (slots > INT32_MAX / 4) {
+                JANET_OUT_OF_MEMORY;
             }
-            bucket = janet_table_find(t, key);
-            if (janet_checktype(bucket->value, JANET_BOOLEAN))
-                --t->deleted;
-            bucket->key = key;
-            bucket->value = value;
-            ++t->count;
+            slots *= 2;
         }
+        janet_table_rehash(t, slots, -1);
+        janet_table_probe(t, key, hash, &free_slot);
     }
+    int32_t entry = janet_table_used(t);
+    t->data[entry].key = key;
+    t->data[entry].value = value;
+    janet_table_setslot(t, free_slot, entry, janet_table_tag(hash));
+    ++t->count;
 }
 
 /* Clear a table */
 void janet_table_clear(JanetTable *t) {
-    int32_t capacity = t->capacity;
-    JanetKV *data = t->data;
-    janet_memempty(data, capacity);
+    if (NULL == t->data) return;
+    janet_memempty(t->data, janet_table_used(t));
+    memset(janet_table_ctrl(t->data, t->capacity), JANET_CTRL_EMPTY,
+           (size_t) janet_table_slots(t->capacity) + JANET_TABLE_GROUP);
     t->count = 0;
     t->deleted = 0;
 }
@@ -230,7 +440,7 @@ void janet_table_clear(JanetTable *t) {
 const JanetKV *janet_table_to_struct(JanetTable *t) {
     JanetKV *st = janet_struct_begin(t->count);
     JanetKV *kv = t->data;
-    JanetKV *end = t->data + t->capacity;
+    JanetKV *end = t->data + janet_table_used(t);
     while (kv < end) {
         if (!janet_checktype(kv->key, JANET_NIL))
             janet_struct_put(st, kv->key, kv->value);
@@ -246,11 +456,16 @@ JanetTable *janet_table_clone(JanetTable *table) {
     newTable->capacity = table->capacity;
     newTable->deleted = table->deleted;
     newTable->proto = table->proto;
-    newTable->data = janet_malloc(newTable->capacity * sizeof(JanetKV));
-    if (NULL == newTable->data) {
-        JANET_OUT_OF_MEMORY;
+    if (table->capacity) {
+        size_t size = janet_table_datasize(table->capacity);
+        newTable->data = janet_malloc(size);
+        if (NULL == newTable->data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        memcpy(newTable->data, table->data, size);
+    } else {
+        newTable->data = NULL;
     }
-    memcpy(newTable->data, table->data, (size_t) table->capacity * sizeof(JanetKV));
     return newTable;
 }
 
@@ -267,7 +482,7 @@ static void janet_table_mergekv(JanetTable *table, const JanetKV *kvs, int32_t c
 
 /* Merge a table into another table */
 void janet_table_merge_table(JanetTable *table, JanetTable *other) {
-    janet_table_mergekv(table, other->data, other->capacity);
+    janet_table_mergekv(table, other->data, janet_table_used(other));
 }
 
 /* Merge a struct into a table */
@@ -340,6 +555,17 @@ JANET_CORE_FN(cfun_table_clone,
     return janet_wrap_table(janet_table_clone(table));
 }
 
+JANET_CORE_FN(cfun_table_compact,
+              "(table/compact tab)",
+              "Drop the space left by removed entries in a table and release unused "
+              "capacity. Tables also shrink automatically when new keys are added after "
+              "most entries were removed. Returns the modified table `tab`.") {
+    janet_fixarity(argc, 1);
+    JanetTable *table = janet_gettable(argv, 0);
+    janet_table_compact(table);
+    return janet_wrap_table(table);
+}
+
 JANET_CORE_FN(cfun_table_clear,
               "(table/clear tab)",
               "Remove all key-value pairs in a table and return the modified table `tab`.") {
@@ -349,6 +575,193 @@ JANET_CORE_FN(cfun_table_clear,
     return janet_wrap_table(table);
 }
 
+/* Keys, values and pairs of any data structure, in the order of next */
+typedef enum {
+    JANET_DICT_KEYS,
+    JANET_DICT_VALUES,
+    JANET_DICT_PAIRS
+} JanetDictPart;
+
+static Janet janet_dict_part(JanetDictPart part, Janet key, Janet value) {
+    if (part == JANET_DICT_KEYS) return key;
+    if (part == JANET_DICT_VALUES) return value;
+    Janet pair[2] = {key, value};
+    return janet_wrap_tuple(janet_tuple_n(pair, 2));
+}
+
+typedef struct {
+    Janet x;
+    JanetDictPart part;
+    JanetArray *array;
+} JanetDictWalk;
+
+static void janet_dict_walk(void *data) {
+    JanetDictWalk *walk = (JanetDictWalk *) data;
+    Janet key = janet_next(walk->x, janet_wrap_nil());
+    while (!janet_checktype(key, JANET_NIL)) {
+        Janet value = (walk->part == JANET_DICT_KEYS) ? janet_wrap_nil() : janet_in(walk->x, key);
+        janet_array_push(walk->array, janet_dict_part(walk->part, key, value));
+        key = janet_next(walk->x, key);
+    }
+}
+
+static Janet janet_dict_parts(Janet x, JanetDictPart part) {
+    JanetArray *array;
+    const JanetKV *kvs = NULL;
+    int32_t cap = 0;
+    if (janet_checktype(x, JANET_TABLE)) {
+        JanetTable *t = janet_unwrap_table(x);
+        kvs = t->data;
+        cap = janet_table_used(t);
+        array = janet_array(t->count);
+    } else if (janet_checktype(x, JANET_STRUCT)) {
+        kvs = janet_unwrap_struct(x);
+        cap = janet_struct_capacity(kvs);
+        array = janet_array(janet_struct_length(kvs));
+    } else {
+        const Janet *items;
+        int32_t len;
+        if (janet_indexed_view(x, &items, &len)) {
+            array = janet_array(len);
+            for (int32_t i = 0; i < len; i++) {
+                array->data[i] = janet_dict_part(part, janet_wrap_integer(i), items[i]);
+            }
+            array->count = len;
+            return janet_wrap_array(array);
+        }
+        /* Fibers can run code, and collect, while we build the array */
+        JanetDictWalk walk;
+        walk.x = x;
+        walk.part = part;
+        walk.array = janet_array(0);
+        Janet root = janet_wrap_array(walk.array);
+        janet_gcrooted(&root, 1, janet_dict_walk, &walk);
+        return root;
+    }
+    for (int32_t i = 0; i < cap; i++) {
+        if (janet_checktype(kvs[i].key, JANET_NIL)) continue;
+        array->data[array->count++] = janet_dict_part(part, kvs[i].key, kvs[i].value);
+    }
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_keys,
+              "(keys x)",
+              "Get the keys of an associative data structure.") {
+    janet_fixarity(argc, 1);
+    return janet_dict_parts(argv[0], JANET_DICT_KEYS);
+}
+
+JANET_CORE_FN(cfun_values,
+              "(values x)",
+              "Get the values of an associative data structure.") {
+    janet_fixarity(argc, 1);
+    return janet_dict_parts(argv[0], JANET_DICT_VALUES);
+}
+
+JANET_CORE_FN(cfun_pairs,
+              "(pairs x)",
+              "Get the key-value pairs of an associative data structure.") {
+    janet_fixarity(argc, 1);
+    return janet_dict_parts(argv[0], JANET_DICT_PAIRS);
+}
+
+static void janet_frequencies_step(Janet x, void *data) {
+    JanetTable *t = (JanetTable *) data;
+    JanetKV *kv = janet_table_entry(t, x);
+    if (NULL != kv) {
+        kv->value = janet_wrap_number(janet_unwrap_number(kv->value) + 1);
+    } else {
+        janet_table_put(t, x, janet_wrap_integer(1));
+    }
+}
+
+JANET_CORE_FN(cfun_frequencies,
+              "(frequencies ind)",
+              "Get the number of occurrences of each value in a indexed structure.") {
+    janet_fixarity(argc, 1);
+    JanetTable *t = janet_table(0);
+    Janet root = janet_wrap_table(t);
+    janet_each_rooted(&root, 1, argv[0], janet_frequencies_step, t);
+    return janet_wrap_table(t);
+}
+
+typedef struct {
+    JanetTable *table;
+    Janet f;
+} JanetGroupBy;
+
+static void janet_group_by_step(Janet x, void *data) {
+    JanetGroupBy *g = (JanetGroupBy *) data;
+    Janet y = janet_call_value(g->f, 1, &x);
+    JanetKV *kv = janet_table_entry(g->table, y);
+    if (NULL != kv && janet_checktype(kv->value, JANET_ARRAY)) {
+        janet_array_push(janet_unwrap_array(kv->value), x);
+    } else {
+        JanetArray *group = janet_array(1);
+        janet_array_push(group, x);
+        janet_table_put(g->table, y, janet_wrap_array(group));
+    }
+    janet_gccheck();
+}
+
+JANET_CORE_FN(cfun_group_by,
+              "(group-by f ind)",
+              "Group elements of `ind` by a function `f` and put the results into a table. The keys of "
+              "the table are the distinct return values of `f`, and the values are arrays of all elements of `ind` "
+              "that are equal to that value.") {
+    janet_fixarity(argc, 2);
+    JanetGroupBy g;
+    g.table = janet_table(0);
+    g.f = argv[0];
+    Janet root = janet_wrap_table(g.table);
+    janet_each_rooted(&root, 1, argv[1], janet_group_by_step, &g);
+    return janet_wrap_table(g.table);
+}
+
+typedef struct {
+    Janet ks;
+    Janet vs;
+    JanetTable *table;
+} JanetZip;
+
+static void janet_zip_walk(void *data) {
+    JanetZip *zip = (JanetZip *) data;
+    Janet kk = janet_wrap_nil();
+    Janet vk = janet_wrap_nil();
+    for (;;) {
+        kk = janet_next(zip->ks, kk);
+        if (janet_checktype(kk, JANET_NIL)) break;
+        vk = janet_next(zip->vs, vk);
+        if (janet_checktype(vk, JANET_NIL)) break;
+        janet_table_put(zip->table, janet_in(zip->ks, kk), janet_in(zip->vs, vk));
+    }
+}
+
+JANET_CORE_FN(cfun_zipcoll,
+              "(zipcoll ks vs)",
+              "Creates a table from two arrays/tuples. "
+              "Returns a new table.") {
+    janet_fixarity(argc, 2);
+    const Janet *ks, *vs;
+    int32_t klen, vlen;
+    if (janet_indexed_view(argv[0], &ks, &klen) && janet_indexed_view(argv[1], &vs, &vlen)) {
+        int32_t len = klen < vlen ? klen : vlen;
+        JanetTable *t = janet_table(len);
+        for (int32_t i = 0; i < len; i++) {
+            janet_table_put(t, ks[i], vs[i]);
+        }
+        return janet_wrap_table(t);
+    }
+    JanetZip zip;
+    zip.ks = argv[0];
+    zip.vs = argv[1];
+    zip.table = janet_table(0);
+    Janet root = janet_wrap_table(zip.table);
+    janet_gcrooted(&root, 1, janet_zip_walk, &zip);
+    return root;
+}
+
 /* Load the table module */
 void janet_lib_table(JanetTable *env) {
     JanetRegExt table_cfuns[] = {
@@ -359,6 +772,13 @@ void janet_lib_table(JanetTable *env) {
         JANET_CORE_REG("table/rawget", cfun_table_rawget),
         JANET_CORE_REG("table/clone", cfun_table_clone),
         JANET_CORE_REG("table/clear", cfun_table_clear),
+        JANET_CORE_REG("table/compact", cfun_table_compact),
+        JANET_CORE_REG("keys", cfun_keys),
+        JANET_CORE_REG("values", cfun_values),
+        JANET_CORE_REG("pairs", cfun_pairs),
+        JANET_CORE_REG("frequencies", cfun_frequencies),
+        JANET_CORE_REG("group-by", cfun_group_by),
+        JANET_CORE_REG("zipcoll", cfun_zipcoll),
         JANET_REG_END
     };
     janet_core_cfuns_ext(env, NULL, table_cfuns);
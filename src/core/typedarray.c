@@ -0,0 +1,675 @@
+/*
+* Copyright (c) 2021 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+
+/* Conditional compilation */
+#ifdef JANET_TYPED_ARRAY
+
+/*
+ * Typed arrays are views of packed numbers in a buffer. A view does not own
+ * its bytes, so several views (of different types, even) can share one
+ * buffer, and changes through one are seen by the others and by the buffer.
+ * The buffer can be resized behind a view's back, so views check that they
+ * still fit in it before each use.
+ */
+
+typedef enum {
+    JANET_TARRAY_U8,
+    JANET_TARRAY_S32,
+    JANET_TARRAY_F32,
+    JANET_TARRAY_F64
+} JanetTArrayType;
+
+#define JANET_TARRAY_TYPE_COUNT 4
+
+static const char *const ta_type_names[JANET_TARRAY_TYPE_COUNT] = {"u8", "s32", "f32", "f64"};
+static const int32_t ta_type_sizes[JANET_TARRAY_TYPE_COUNT] = {1, 4, 4, 8};
+
+typedef struct {
+    JanetBuffer *buffer;
+    int32_t offset;
+    int32_t count;
+    JanetTArrayType type;
+} JanetTArray;
+
+typedef union {
+    uint8_t u8;
+    int32_t s32;
+    float f32;
+    double f64;
+} JanetTArrayScalar;
+
+typedef enum {
+    JANET_TARRAY_ADD,
+    JANET_TARRAY_SUB,
+    JANET_TARRAY_MUL,
+    JANET_TARRAY_DIV
+} JanetTArrayOp;
+
+/* Get the bytes of a view, checking that the buffer still holds them */
+static uint8_t *ta_data(JanetTArray *ta) {
+    int64_t end = (int64_t) ta->offset + (int64_t) ta->count * ta_type_sizes[ta->type];
+    if (end > ta->buffer->count) janet_panic("typed array no longer fits in its buffer");
+    return ta->buffer->data + ta->offset;
+}
+
+static double ta_ref(JanetTArrayType type, const uint8_t *data, int32_t i) {
+    switch (type) {
+        case JANET_TARRAY_U8:
+            return data[i];
+        case JANET_TARRAY_S32:
+            return ((const int32_t *) data)[i];
+        case JANET_TARRAY_F32:
+            return ((const float *) data)[i];
+        default:
+            return ((const double *) data)[i];
+    }
+}
+
+static JanetTArrayScalar ta_scalar(JanetTArrayType type, Janet x) {
+    JanetTArrayScalar s;
+    if (!janet_checktype(x, JANET_NUMBER)) janet_panicf("expected number, got %v", x);
+    double d = janet_unwrap_number(x);
+    switch (type) {
+        case JANET_TARRAY_U8:
+            if (!(d >= 0 && d <= 255 && d == floor(d)))
+                janet_panicf("expected integer in range [0, 255], got %v", x);
+            s.u8 = (uint8_t) d;
+            break;
+        case JANET_TARRAY_S32:
+            if (!janet_checkint(x)) janet_panicf("expected 32 bit signed integer, got %v", x);
+            s.s32 = janet_unwrap_integer(x);
+            break;
+        case JANET_TARRAY_F32:
+            s.f32 = (float) d;
+            break;
+        default:
+            s.f64 = d;
+            break;
+    }
+    return s;
+}
+
+static void ta_set(JanetTArrayType type, uint8_t *data, int32_t i, Janet x) {
+    JanetTArrayScalar s = ta_scalar(type, x);
+    switch (type) {
+        case JANET_TARRAY_U8:
+            data[i] = s.u8;
+            break;
+        case JANET_TARRAY_S32:
+            ((int32_t *) data)[i] = s.s32;
+            break;
+        case JANET_TARRAY_F32:
+            ((float *) data)[i] = s.f32;
+            break;
+        default:
+            ((double *) data)[i] = s.f64;
+            break;
+    }
+}
+
+/*
+ * Elementwise kernels. b is NULL when the right operand is the scalar bs.
+ * Integer arithmetic wraps around.
+ */
+
+typedef void (*JanetTArrayKernel)(void *dst, const void *a, const void *b, JanetTArrayScalar bs, int32_t n);
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define ta_loadi(p) _mm_loadu_si128((const __m128i *)(p))
+#define ta_storei(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define ta_set1_u8(x) _mm_set1_epi8((char)(x))
+
+/* Handle whole vectors, returning how many elements were done */
+#define JANET_TA_SSE2_KERNEL(NAME, T, VT, W, LOAD, STORE, SET1, VOP) \
+static int32_t NAME(T *dst, const T *a, const T *b, T bs, int32_t n) { \
+    int32_t i = 0; \
+    VT vb = SET1(bs); \
+    for (; i + (W) <= n; i += (W)) { \
+        VT y = b ? LOAD(b + i) : vb; \
+        STORE(dst + i, VOP(LOAD(a + i), y)); \
+    } \
+    return i; \
+}
+
+JANET_TA_SSE2_KERNEL(ta_u8_add_sse2, uint8_t, __m128i, 16, ta_loadi, ta_storei, ta_set1_u8, _mm_add_epi8)
+JANET_TA_SSE2_KERNEL(ta_u8_sub_sse2, uint8_t, __m128i, 16, ta_loadi, ta_storei, ta_set1_u8, _mm_sub_epi8)
+JANET_TA_SSE2_KERNEL(ta_s32_add_sse2, int32_t, __m128i, 4, ta_loadi, ta_storei, _mm_set1_epi32, _mm_add_epi32)
+JANET_TA_SSE2_KERNEL(ta_s32_sub_sse2, int32_t, __m128i, 4, ta_loadi, ta_storei, _mm_set1_epi32, _mm_sub_epi32)
+JANET_TA_SSE2_KERNEL(ta_f32_add_sse2, float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_add_ps)
+JANET_TA_SSE2_KERNEL(ta_f32_sub_sse2, float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_sub_ps)
+JANET_TA_SSE2_KERNEL(ta_f32_mul_sse2, float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_mul_ps)
+JANET_TA_SSE2_KERNEL(ta_f32_div_sse2, float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_div_ps)
+JANET_TA_SSE2_KERNEL(ta_f64_add_sse2, double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd)
+JANET_TA_SSE2_KERNEL(ta_f64_sub_sse2, double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_sub_pd)
+JANET_TA_SSE2_KERNEL(ta_f64_mul_sse2, double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_mul_pd)
+JANET_TA_SSE2_KERNEL(ta_f64_div_sse2, double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_div_pd)
+
+#define JANET_TA_VECTORIZED(kernel) kernel(dst, a, b, bs, n)
+#else
+#define JANET_TA_VECTORIZED(kernel) 0
+#endif
+
+/* Finish with scalar code after the vectorized part, if any */
+#define JANET_TA_KERNEL(NAME, T, FIELD, EXPR, START) \
+static void NAME(void *dstp, const void *ap, const void *bp, JanetTArrayScalar s, int32_t n) { \
+    T *dst = (T *) dstp; \
+    const T *a = (const T *) ap; \
+    const T *b = (const T *) bp; \
+    T bs = s.FIELD; \
+    for (int32_t i = START; i < n; i++) { \
+        T x = a[i]; \
+        T y = b ? b[i] : bs; \
+        dst[i] = (T)(EXPR); \
+    } \
+}
+
+JANET_TA_KERNEL(ta_u8_add, uint8_t, u8, x + y, JANET_TA_VECTORIZED(ta_u8_add_sse2))
+JANET_TA_KERNEL(ta_u8_sub, uint8_t, u8, x - y, JANET_TA_VECTORIZED(ta_u8_sub_sse2))
+JANET_TA_KERNEL(ta_u8_mul, uint8_t, u8, x * y, 0)
+JANET_TA_KERNEL(ta_u8_div, uint8_t, u8, x / y, 0)
+JANET_TA_KERNEL(ta_s32_add, int32_t, s32, (uint32_t) x + (uint32_t) y, JANET_TA_VECTORIZED(ta_s32_add_sse2))
+JANET_TA_KERNEL(ta_s32_sub, int32_t, s32, (uint32_t) x - (uint32_t) y, JANET_TA_VECTORIZED(ta_s32_sub_sse2))
+JANET_TA_KERNEL(ta_s32_mul, int32_t, s32, (uint32_t) x * (uint32_t) y, 0)
+JANET_TA_KERNEL(ta_s32_div, int32_t, s32, y == -1 ? 0u - (uint32_t) x : (uint32_t)(x / y), 0)
+JANET_TA_KERNEL(ta_f32_add, float, f32, x + y, JANET_TA_VECTORIZED(ta_f32_add_sse2))
+JANET_TA_KERNEL(ta_f32_sub, float, f32, x - y, JANET_TA_VECTORIZED(ta_f32_sub_sse2))
+JANET_TA_KERNEL(ta_f32_mul, float, f32, x * y, JANET_TA_VECTORIZED(ta_f32_mul_sse2))
+JANET_TA_KERNEL(ta_f32_div, float, f32, x / y, JANET_TA_VECTORIZED(ta_f32_div_sse2))
+JANET_TA_KERNEL(ta_f64_add, double, f64, x + y, JANET_TA_VECTORIZED(ta_f64_add_sse2))
+JANET_TA_KERNEL(ta_f64_sub, double, f64, x - y, JANET_TA_VECTORIZED(ta_f64_sub_sse2))
+JANET_TA_KERNEL(ta_f64_mul, double, f64, x * y, JANET_TA_VECTORIZED(ta_f64_mul_sse2))
+JANET_TA_KERNEL(ta_f64_div, double, f64, x / y, JANET_TA_VECTORIZED(ta_f64_div_sse2))
+
+static const JanetTArrayKernel ta_kernels[JANET_TARRAY_TYPE_COUNT][4] = {
+    {ta_u8_add, ta_u8_sub, ta_u8_mul, ta_u8_div},
+    {ta_s32_add, ta_s32_sub, ta_s32_mul, ta_s32_div},
+    {ta_f32_add, ta_f32_sub, ta_f32_mul, ta_f32_div},
+    {ta_f64_add, ta_f64_sub, ta_f64_mul, ta_f64_div}
+};
+
+/*
+ * Reductions. Sums and dot products accumulate in double precision (or
+ * 64 bit integers for u8), so the vectorized and scalar versions can round
+ * differently in the last place.
+ */
+
+static double ta_sum(JanetTArrayType type, const uint8_t *data, int32_t n) {
+    int32_t i = 0;
+    switch (type) {
+        case JANET_TARRAY_U8: {
+            int64_t sum = 0;
+            for (; i < n; i++) sum += data[i];
+            return (double) sum;
+        }
+        case JANET_TARRAY_S32: {
+            const int32_t *a = (const int32_t *) data;
+            int64_t sum = 0;
+            for (; i < n; i++) sum += a[i];
+            return (double) sum;
+        }
+        case JANET_TARRAY_F32: {
+            const float *a = (const float *) data;
+            double sum = 0;
+#ifdef __SSE2__
+            __m128d acc = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(a + i);
+                acc = _mm_add_pd(acc, _mm_cvtps_pd(x));
+                acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, acc);
+            sum = lanes[0] + lanes[1];
+#endif
+            for (; i < n; i++) sum += a[i];
+            return sum;
+        }
+        default: {
+            const double *a = (const double *) data;
+            double sum = 0;
+#ifdef __SSE2__
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+                acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+            sum = lanes[0] + lanes[1];
+#endif
+            for (; i < n; i++) sum += a[i];
+            return sum;
+        }
+    }
+}
+
+static double ta_dot(JanetTArrayType type, const uint8_t *adata, const uint8_t *bdata, int32_t n) {
+    int32_t i = 0;
+    switch (type) {
+        case JANET_TARRAY_U8: {
+            int64_t sum = 0;
+            for (; i < n; i++) sum += (int64_t) adata[i] * bdata[i];
+            return (double) sum;
+        }
+        case JANET_TARRAY_S32: {
+            const int32_t *a = (const int32_t *) adata;
+            const int32_t *b = (const int32_t *) bdata;
+            double sum = 0;
+            for (; i < n; i++) sum += (double)((int64_t) a[i] * b[i]);
+            return sum;
+        }
+        case JANET_TARRAY_F32: {
+            const float *a = (const float *) adata;
+            const float *b = (const float *) bdata;
+            double sum = 0;
+#ifdef __SSE2__
+            __m128d acc = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(a + i);
+                __m128 y = _mm_loadu_ps(b + i);
+                acc = _mm_add_pd(acc, _mm_mul_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y)));
+                acc = _mm_add_pd(acc, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                                                 _mm_cvtps_pd(_mm_movehl_ps(y, y))));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, acc);
+            sum = lanes[0] + lanes[1];
+#endif
+            for (; i < n; i++) sum += (double) a[i] * b[i];
+            return sum;
+        }
+        default: {
+            const double *a = (const double *) adata;
+            const double *b = (const double *) bdata;
+            double sum = 0;
+#ifdef __SSE2__
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+            sum = lanes[0] + lanes[1];
+#endif
+            for (; i < n; i++) sum += a[i] * b[i];
+            return sum;
+        }
+    }
+}
+
+/* Smallest (or largest) element of a non-empty array. Results with NaNs
+ * depend on where the NaNs are. */
+static double ta_extreme(JanetTArrayType type, const uint8_t *data, int32_t n, int max) {
+    int32_t i = 1;
+    double best = ta_ref(type, data, 0);
+#ifdef __SSE2__
+    if (type == JANET_TARRAY_F64 && n >= 2) {
+        const double *a = (const double *) data;
+        __m128d acc = _mm_loadu_pd(a);
+        for (i = 2; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(a + i);
+            acc = max ? _mm_max_pd(x, acc) : _mm_min_pd(x, acc);
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        best = max ? (lanes[1] > lanes[0] ? lanes[1] : lanes[0])
+               : (lanes[1] < lanes[0] ? lanes[1] : lanes[0]);
+    } else if (type == JANET_TARRAY_F32 && n >= 4) {
+        const float *a = (const float *) data;
+        __m128 acc = _mm_loadu_ps(a);
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(a + i);
+            acc = max ? _mm_max_ps(x, acc) : _mm_min_ps(x, acc);
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        best = lanes[0];
+        for (int j = 1; j < 4; j++) {
+            if (max ? lanes[j] > best : lanes[j] < best) best = lanes[j];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        double x = ta_ref(type, data, i);
+        if (max ? x > best : x < best) best = x;
+    }
+    return best;
+}
+
+/*
+ * Abstract type
+ */
+
+static int ta_gcmark(void *p, size_t size) {
+    (void) size;
+    janet_mark(janet_wrap_buffer(((JanetTArray *) p)->buffer));
+    return 0;
+}
+
+static int ta_get(void *p, Janet key, Janet *out) {
+    JanetTArray *ta = (JanetTArray *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= ta->count) return 0;
+    *out = janet_wrap_number(ta_ref(ta->type, ta_data(ta), i));
+    return 1;
+}
+
+static void ta_put(void *p, Janet key, Janet value) {
+    JanetTArray *ta = (JanetTArray *) p;
+    if (!janet_checkint(key)) janet_panicf("expected integer key, got %v", key);
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= ta->count) janet_panicf("index %d out of range [0,%d)", i, ta->count);
+    ta_set(ta->type, ta_data(ta), i, value);
+}
+
+static Janet ta_next(void *p, Janet key) {
+    JanetTArray *ta = (JanetTArray *) p;
+    if (janet_checktype(key, JANET_NIL)) {
+        return ta->count ? janet_wrap_integer(0) : janet_wrap_nil();
+    }
+    if (!janet_checkint(key)) return janet_wrap_nil();
+    int32_t i = janet_unwrap_integer(key);
+    return (i >= 0 && i + 1 < ta->count) ? janet_wrap_integer(i + 1) : janet_wrap_nil();
+}
+
+static int32_t ta_length(void *p, size_t size) {
+    (void) size;
+    return ((JanetTArray *) p)->count;
+}
+
+static void ta_tostring(void *p, JanetBuffer *buffer) {
+    JanetTArray *ta = (JanetTArray *) p;
+    const uint8_t *data = ta_data(ta);
+    janet_buffer_push_cstring(buffer, ta_type_names[ta->type]);
+    janet_buffer_push_cstring(buffer, " [");
+    for (int32_t i = 0; i < ta->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_description_b(buffer, janet_wrap_number(ta_ref(ta->type, data, i)));
+    }
+    janet_buffer_push_u8(buffer, ']');
+}
+
+/* Views of the same buffer stay shared through marshal and unmarshal */
+static void ta_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetTArray *ta = (JanetTArray *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, ta->type);
+    janet_marshal_int(ctx, ta->offset);
+    janet_marshal_int(ctx, ta->count);
+    janet_marshal_janet(ctx, janet_wrap_buffer(ta->buffer));
+}
+
+static void *ta_unmarshal(JanetMarshalContext *ctx) {
+    JanetTArray *ta = janet_unmarshal_abstract(ctx, sizeof(JanetTArray));
+    int32_t type = janet_unmarshal_int(ctx);
+    int32_t offset = janet_unmarshal_int(ctx);
+    int32_t count = janet_unmarshal_int(ctx);
+    Janet buffer = janet_unmarshal_janet(ctx);
+    if (type < 0 || type >= JANET_TARRAY_TYPE_COUNT || offset < 0 || count < 0 ||
+            !janet_checktype(buffer, JANET_BUFFER)) {
+        janet_panic("invalid typed array");
+    }
+    ta->type = (JanetTArrayType) type;
+    ta->offset = offset;
+    ta->count = count;
+    ta->buffer = janet_unwrap_buffer(buffer);
+    ta_data(ta);
+    return ta;
+}
+
+static const JanetAbstractType janet_tarray_type = {
+    "core/tarray",
+    NULL,
+    ta_gcmark,
+    ta_get,
+    ta_put,
+    ta_marshal,
+    ta_unmarshal,
+    ta_tostring,
+    NULL,
+    NULL,
+    ta_next,
+    NULL,
+    ta_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetTArrayType ta_gettype(const Janet *argv, int32_t n) {
+    const uint8_t *name = janet_getkeyword(argv, n);
+    for (int i = 0; i < JANET_TARRAY_TYPE_COUNT; i++) {
+        if (!janet_cstrcmp(name, ta_type_names[i])) return (JanetTArrayType) i;
+    }
+    janet_panicf("expected one of :u8, :s32, :f32 or :f64, got %v", argv[n]);
+}
+
+static JanetTArray *ta_view(JanetTArrayType type, JanetBuffer *buffer, int32_t offset, int32_t count) {
+    JanetTArray *ta = janet_abstract(&janet_tarray_type, sizeof(JanetTArray));
+    ta->buffer = buffer;
+    ta->offset = offset;
+    ta->count = count;
+    ta->type = type;
+    return ta;
+}
+
+static JanetTArray *ta_alloc(JanetTArrayType type, int32_t count) {
+    if (count > INT32_MAX / ta_type_sizes[type]) janet_panic("typed array too large");
+    int32_t size = count * ta_type_sizes[type];
+    JanetBuffer *buffer = janet_buffer(size);
+    if (size) memset(buffer->data, 0, size);
+    buffer->count = size;
+    return ta_view(type, buffer, 0, count);
+}
+
+static JanetTArray *ta_getsame(const Janet *argv, int32_t n, JanetTArray *like) {
+    JanetTArray *ta = janet_getabstract(argv, n, &janet_tarray_type);
+    if (ta->type != like->type || ta->count != like->count) {
+        janet_panicf("bad slot #%d, expected %s typed array of length %d, got %v",
+                     n, ta_type_names[like->type], like->count, argv[n]);
+    }
+    return ta;
+}
+
+static Janet ta_binop(int32_t argc, Janet *argv, JanetTArrayOp op) {
+    janet_arity(argc, 2, 3);
+    JanetTArray *a = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetTArray *b = NULL;
+    JanetTArrayScalar bs;
+    if (janet_checktype(argv[1], JANET_NUMBER)) {
+        bs = ta_scalar(a->type, argv[1]);
+    } else {
+        b = ta_getsame(argv, 1, a);
+        bs.f64 = 0;
+    }
+    JanetTArray *out = (argc > 2 && !janet_checktype(argv[2], JANET_NIL))
+                       ? ta_getsame(argv, 2, a)
+                       : ta_alloc(a->type, a->count);
+    const uint8_t *adata = ta_data(a);
+    const uint8_t *bdata = b ? ta_data(b) : NULL;
+    uint8_t *dst = ta_data(out);
+    if (op == JANET_TARRAY_DIV && a->type == JANET_TARRAY_U8) {
+        if (b == NULL ? bs.u8 == 0 : memchr(bdata, 0, b->count) != NULL) {
+            janet_panic("division by zero");
+        }
+    } else if (op == JANET_TARRAY_DIV && a->type == JANET_TARRAY_S32) {
+        if (b == NULL && bs.s32 == 0) janet_panic("division by zero");
+        for (int32_t i = 0; b != NULL && i < b->count; i++) {
+            if (((const int32_t *) bdata)[i] == 0) janet_panic("division by zero");
+        }
+    }
+    ta_kernels[a->type][op](dst, adata, bdata, bs, a->count);
+    return janet_wrap_abstract(out);
+}
+
+JANET_CORE_FN(cfun_tarray_new,
+              "(tarray/new type size-or-values)",
+              "Create a typed array of type :u8, :s32, :f32 or :f64 in a new buffer. "
+              "The second argument is either the number of elements, which start as 0, "
+              "or an indexed collection of numbers to copy. Typed arrays can be indexed, "
+              "put into and iterated like arrays, but store unboxed numbers.") {
+    janet_fixarity(argc, 2);
+    JanetTArrayType type = ta_gettype(argv, 0);
+    if (janet_checktype(argv[1], JANET_NUMBER)) {
+        int32_t count = janet_getnat(argv, 1);
+        return janet_wrap_abstract(ta_alloc(type, count));
+    }
+    JanetView values = janet_getindexed(argv, 1);
+    JanetTArray *ta = ta_alloc(type, values.len);
+    uint8_t *data = ta_data(ta);
+    for (int32_t i = 0; i < values.len; i++) {
+        ta_set(type, data, i, values.items[i]);
+    }
+    return janet_wrap_abstract(ta);
+}
+
+JANET_CORE_FN(cfun_tarray_view,
+              "(tarray/view type buffer &opt offset count)",
+              "Create a typed array that reads and writes the bytes of buffer, starting "
+              "offset bytes in, without copying them. offset defaults to 0 and must be a "
+              "multiple of the element size. count defaults to as many elements as fit.") {
+    janet_arity(argc, 2, 4);
+    JanetTArrayType type = ta_gettype(argv, 0);
+    JanetBuffer *buffer = janet_getbuffer(argv, 1);
+    int32_t size = ta_type_sizes[type];
+    int32_t offset = janet_optnat(argv, argc, 2, 0);
+    if (offset % size) janet_panicf("offset %d is not a multiple of %d", offset, size);
+    if (offset > buffer->count) janet_panicf("offset %d is past the end of the buffer", offset);
+    int32_t count = janet_optnat(argv, argc, 3, (buffer->count - offset) / size);
+    if ((int64_t) count * size > buffer->count - offset) {
+        janet_panicf("%d elements do not fit in the buffer", count);
+    }
+    return janet_wrap_abstract(ta_view(type, buffer, offset, count));
+}
+
+JANET_CORE_FN(cfun_tarray_buffer,
+              "(tarray/buffer tarray)",
+              "Get the buffer that holds the elements of a typed array.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *ta = janet_getabstract(argv, 0, &janet_tarray_type);
+    return janet_wrap_buffer(ta->buffer);
+}
+
+JANET_CORE_FN(cfun_tarray_type,
+              "(tarray/type tarray)",
+              "Get the element type of a typed array as a keyword.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *ta = janet_getabstract(argv, 0, &janet_tarray_type);
+    return janet_ckeywordv(ta_type_names[ta->type]);
+}
+
+JANET_CORE_FN(cfun_tarray_add,
+              "(tarray/add a b &opt out)",
+              "Add typed array a and either a typed array of the same type and length or a "
+              "number, element by element. Writes the result to out, which may be a or b, "
+              "or to a new typed array, and returns it.") {
+    return ta_binop(argc, argv, JANET_TARRAY_ADD);
+}
+
+JANET_CORE_FN(cfun_tarray_sub,
+              "(tarray/sub a b &opt out)",
+              "Subtract b from typed array a element by element. See tarray/add.") {
+    return ta_binop(argc, argv, JANET_TARRAY_SUB);
+}
+
+JANET_CORE_FN(cfun_tarray_mul,
+              "(tarray/mul a b &opt out)",
+              "Multiply typed array a by b element by element. See tarray/add.") {
+    return ta_binop(argc, argv, JANET_TARRAY_MUL);
+}
+
+JANET_CORE_FN(cfun_tarray_div,
+              "(tarray/div a b &opt out)",
+              "Divide typed array a by b element by element. Integer division truncates "
+              "and raises an error on division by zero. See tarray/add.") {
+    return ta_binop(argc, argv, JANET_TARRAY_DIV);
+}
+
+JANET_CORE_FN(cfun_tarray_sum,
+              "(tarray/sum tarray)",
+              "Get the sum of the elements of a typed array.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *ta = janet_getabstract(argv, 0, &janet_tarray_type);
+    return janet_wrap_number(ta_sum(ta->type, ta_data(ta), ta->count));
+}
+
+JANET_CORE_FN(cfun_tarray_dot,
+              "(tarray/dot a b)",
+              "Get the dot product of two typed arrays of the same type and length.") {
+    janet_fixarity(argc, 2);
+    JanetTArray *a = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetTArray *b = ta_getsame(argv, 1, a);
+    return janet_wrap_number(ta_dot(a->type, ta_data(a), ta_data(b), a->count));
+}
+
+JANET_CORE_FN(cfun_tarray_min,
+              "(tarray/min tarray)",
+              "Get the smallest element of a typed array, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *ta = janet_getabstract(argv, 0, &janet_tarray_type);
+    if (ta->count == 0) return janet_wrap_nil();
+    return janet_wrap_number(ta_extreme(ta->type, ta_data(ta), ta->count, 0));
+}
+
+JANET_CORE_FN(cfun_tarray_max,
+              "(tarray/max tarray)",
+              "Get the largest element of a typed array, or nil if it is empty.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *ta = janet_getabstract(argv, 0, &janet_tarray_type);
+    if (ta->count == 0) return janet_wrap_nil();
+    return janet_wrap_number(ta_extreme(ta->type, ta_data(ta), ta->count, 1));
+}
+
+/* Module entry point */
+void janet_lib_typed_array(JanetTable *env) {
+    JanetRegExt ta_cfuns[] = {
+        JANET_CORE_REG("tarray/new", cfun_tarray_new),
+        JANET_CORE_REG("tarray/view", cfun_tarray_view),
+        JANET_CORE_REG("tarray/buffer", cfun_tarray_buffer),
+        JANET_CORE_REG("tarray/type", cfun_tarray_type),
+        JANET_CORE_REG("tarray/add", cfun_tarray_add),
+        JANET_CORE_REG("tarray/sub", cfun_tarray_sub),
+        JANET_CORE_REG("tarray/mul", cfun_tarray_mul),
+        JANET_CORE_REG("tarray/div", cfun_tarray_div),
+        JANET_CORE_REG("tarray/sum", cfun_tarray_sum),
+        JANET_CORE_REG("tarray/dot", cfun_tarray_dot),
+        JANET_CORE_REG("tarray/min", cfun_tarray_min),
+        JANET_CORE_REG("tarray/max", cfun_tarray_max),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, ta_cfuns);
+    janet_register_abstract_type(&janet_tarray_type);
+}
+
+#endif
@@ -102,14 +102,114 @@ const char *const janet_status_names[16] = {
     "alive"
 };
 
+static uint8_t hash_key[JANET_HASH_KEY_SIZE] = {0};
+
+void janet_init_hash_key(uint8_t new_key[JANET_HASH_KEY_SIZE]) {
+    memcpy(hash_key, new_key, sizeof(hash_key));
+}
+
 #ifndef JANET_PRF
 
+/*
+  String hash based on the public domain wyhash (final version 3) by Wang Yi:
+
+  https://github.com/wangyi-fudan/wyhash
+
+  It reads 8 bytes at a time with three independent lanes for long strings,
+  and is seeded from the hash key. Build with JANET_PRF for the slower but
+  cryptographically stronger halfsiphash.
+*/
+
+static const uint64_t wyp[4] = {
+    UINT64_C(0xa0761d6478bd642f), UINT64_C(0xe7037ed1a0b428db),
+    UINT64_C(0x8ebc6af09c88c6e3), UINT64_C(0x589965cc75374cc3)
+};
+
+static void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t wyr3(const uint8_t *p, size_t k) {
+    return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed) {
+    uint64_t a, b;
+    seed ^= wymix(seed ^ wyp[0], wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+/* end of wyhash */
+
+/* Calculate hash for string */
+
 int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
-    const uint8_t *end = str + len;
-    uint32_t hash = 5381;
-    while (str < end)
-        hash = (hash << 5) + hash + *str++;
-    return (int32_t) hash;
+    uint64_t h = wyhash(str, (size_t) len, wyr8(hash_key) ^ wyr8(hash_key + 8));
+    uint32_t hash = (uint32_t)(h ^ (h >> 32));
+    /* 0 marks a string whose hash has not been computed yet */
+    return hash ? (int32_t) hash : 1;
 }
 
 #else
@@ -208,18 +308,13 @@ static uint32_t halfsiphash(const uint8_t *in, const size_t inlen, const uint8_t
 }
 /* end of siphash */
 
-static uint8_t hash_key[JANET_HASH_KEY_SIZE] = {0};
-
-void janet_init_hash_key(uint8_t new_key[JANET_HASH_KEY_SIZE]) {
-    memcpy(hash_key, new_key, sizeof(hash_key));
-}
-
 /* Calculate hash for string */
 
 int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
     uint32_t hash;
     hash = halfsiphash(str, len, hash_key);
-    return (int32_t)hash;
+    /* 0 marks a string whose hash has not been computed yet */
+    return hash ? (int32_t) hash : 1;
 }
 
 #endif
@@ -299,12 +394,32 @@ const JanetKV *janet_dict_find(const JanetKV *buckets, int32_t cap, Janet key) {
     return first_bucket;
 }
 
-/* Get a value from a janet struct or table. */
+/* Get a value from the buckets of a struct or a dictionary view. The view
+ * of a table is in insertion order rather than hashed, but it never holds an
+ * empty bucket, so a probe that does not end on one scans all buckets. */
 Janet janet_dictionary_get(const JanetKV *data, int32_t cap, Janet key) {
+    if (cap <= 0 || janet_checktype(key, JANET_NIL)) return janet_wrap_nil();
     const JanetKV *kv = janet_dict_find(data, cap, key);
     if (kv && !janet_checktype(kv->key, JANET_NIL)) {
         return kv->value;
     }
+    if (kv && janet_checktype(kv->value, JANET_NIL)) {
+        return janet_wrap_nil();
+    }
+    for (int32_t i = 0; i < cap; i++) {
+        if (janet_equals(data[i].key, key)) return data[i].value;
+    }
+    return janet_wrap_nil();
+}
+
+/* Get a value from a table or struct without checking prototypes. Unlike
+ * janet_dictionary_get, this uses the hash index of a table. */
+Janet janet_dictionary_rawget(Janet dict, Janet key) {
+    if (janet_checktype(dict, JANET_TABLE)) {
+        return janet_table_rawget(janet_unwrap_table(dict), key);
+    } else if (janet_checktype(dict, JANET_STRUCT)) {
+        return janet_struct_get(janet_unwrap_struct(dict), key);
+    }
     return janet_wrap_nil();
 }
 
@@ -684,18 +799,23 @@ int janet_bytes_view(Janet str, const uint8_t **data, int32_t *len) {
         *data = janet_unwrap_buffer(str)->data;
         *len = janet_unwrap_buffer(str)->count;
         return 1;
+    } else if (janet_checktype(str, JANET_ABSTRACT) &&
+               janet_abstract_type(janet_unwrap_abstract(str)) == &janet_rope_type) {
+        *data = janet_rope_bytes((JanetRope *) janet_unwrap_abstract(str), len);
+        return 1;
     }
     return 0;
 }
 
-/* Read both structs and tables as the entries of a hashtable with
- * identical structure. Returns 1 if the view can be constructed and
- * 0 if the type is invalid. */
+/* Read both structs and tables as an array of buckets that can be
+ * iterated with janet_dictionary_next. Returns 1 if the view can be
+ * constructed and 0 if the type is invalid. */
 int janet_dictionary_view(Janet tab, const JanetKV **data, int32_t *len, int32_t *cap) {
     if (janet_checktype(tab, JANET_TABLE)) {
-        *data = janet_unwrap_table(tab)->data;
-        *cap = janet_unwrap_table(tab)->capacity;
-        *len = janet_unwrap_table(tab)->count;
+        JanetTable *t = janet_unwrap_table(tab);
+        *data = t->data;
+        *cap = t->count + t->deleted;
+        *len = t->count;
         return 1;
     } else if (janet_checktype(tab, JANET_STRUCT)) {
         *data = janet_unwrap_struct(tab);
@@ -773,6 +893,169 @@ int32_t janet_sorted_keys(const JanetKV *dict, int32_t cap, int32_t *index_buffe
 
 }
 
+/* Call fn on each value of ds, in the same order as each. Arrays and buffers
+ * are read again on every step, as fn may push to them. */
+void janet_each(Janet ds, void (*fn)(Janet x, void *data), void *data) {
+    switch (janet_type(ds)) {
+        case JANET_ARRAY: {
+            JanetArray *array = janet_unwrap_array(ds);
+            for (int32_t i = 0; i < array->count; i++) fn(array->data[i], data);
+            break;
+        }
+        case JANET_TUPLE: {
+            const Janet *tup = janet_unwrap_tuple(ds);
+            int32_t len = janet_tuple_length(tup);
+            for (int32_t i = 0; i < len; i++) fn(tup[i], data);
+            break;
+        }
+        case JANET_BUFFER: {
+            JanetBuffer *buffer = janet_unwrap_buffer(ds);
+            for (int32_t i = 0; i < buffer->count; i++) fn(janet_wrap_integer(buffer->data[i]), data);
+            break;
+        }
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD: {
+            const uint8_t *str = janet_unwrap_string(ds);
+            int32_t len = janet_string_length(str);
+            for (int32_t i = 0; i < len; i++) fn(janet_wrap_integer(str[i]), data);
+            break;
+        }
+        default: {
+            Janet key = janet_next(ds, janet_wrap_nil());
+            while (!janet_checktype(key, JANET_NIL)) {
+                fn(janet_in(ds, key), data);
+                key = janet_next(ds, key);
+            }
+            break;
+        }
+    }
+}
+
+/* Calls from C into user code with janet_call do not collect garbage, so C
+ * functions that make many such calls check between them. */
+void janet_gccheck(void) {
+    if (janet_vm.next_collection >= janet_vm.gc_interval) janet_collect();
+}
+
+/* Run fn(data) with the given values registered as GC roots. C functions
+ * that build results while running user code or resuming fibers keep them
+ * reachable this way instead of pausing collection. The roots are released
+ * whether fn returns or panics. */
+void janet_gcrooted(const Janet *roots, int32_t n, void (*fn)(void *data), void *data) {
+    for (int32_t i = 0; i < n; i++) janet_gcroot(roots[i]);
+    JanetTryState tstate;
+    JanetSignal signal = janet_try(&tstate);
+    if (!signal) fn(data);
+    janet_restore(&tstate);
+    for (int32_t i = 0; i < n; i++) janet_gcunroot(roots[i]);
+    if (signal) janet_panicv(tstate.payload);
+}
+
+typedef struct {
+    Janet ds;
+    void (*fn)(Janet x, void *data);
+    void *data;
+} JanetEachState;
+
+static void janet_each_run(void *data) {
+    JanetEachState *state = (JanetEachState *) data;
+    janet_each(state->ds, state->fn, state->data);
+}
+
+/* janet_each with the given values registered as GC roots */
+void janet_each_rooted(const Janet *roots, int32_t n, Janet ds, void (*fn)(Janet x, void *data), void *data) {
+    JanetEachState state;
+    state.ds = ds;
+    state.fn = fn;
+    state.data = data;
+    janet_gcrooted(roots, n, janet_each_run, &state);
+}
+
+/* Ring buffer queues of fixed size items. One slot is always left empty
+ * so that head == tail means the queue is empty. */
+
+#define JANET_MAX_Q_CAPACITY 0x7FFFFFF
+
+void janet_q_init(JanetQueue *q) {
+    q->data = NULL;
+    q->head = 0;
+    q->tail = 0;
+    q->capacity = 0;
+}
+
+void janet_q_deinit(JanetQueue *q) {
+    janet_free(q->data);
+}
+
+int32_t janet_q_count(JanetQueue *q) {
+    return (q->head > q->tail)
+           ? (q->tail + q->capacity - q->head)
+           : (q->tail - q->head);
+}
+
+/* Make room for one more item. Returns 1 if the queue is full. */
+static int janet_q_grow(JanetQueue *q, size_t itemsize) {
+    int32_t count = janet_q_count(q);
+    if (count + 1 >= q->capacity) {
+        if (count + 1 >= JANET_MAX_Q_CAPACITY) return 1;
+        int32_t newcap = (count + 2) * 2;
+        if (newcap > JANET_MAX_Q_CAPACITY) newcap = JANET_MAX_Q_CAPACITY;
+        q->data = janet_realloc(q->data, itemsize * newcap);
+        if (NULL == q->data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        if (q->head > q->tail) {
+            /* Two segments, fix 2nd seg. */
+            int32_t newhead = q->head + (newcap - q->capacity);
+            size_t seg1 = (size_t)(q->capacity - q->head);
+            if (seg1 > 0) {
+                memmove((char *) q->data + (newhead * itemsize),
+                        (char *) q->data + (q->head * itemsize),
+                        seg1 * itemsize);
+            }
+            q->head = newhead;
+        }
+        q->capacity = newcap;
+    }
+    return 0;
+}
+
+int janet_q_push(JanetQueue *q, void *item, size_t itemsize) {
+    if (janet_q_grow(q, itemsize)) return 1;
+    memcpy((char *) q->data + itemsize * q->tail, item, itemsize);
+    q->tail = q->tail + 1 < q->capacity ? q->tail + 1 : 0;
+    return 0;
+}
+
+int janet_q_push_head(JanetQueue *q, void *item, size_t itemsize) {
+    if (janet_q_grow(q, itemsize)) return 1;
+    q->head = q->head > 0 ? q->head - 1 : q->capacity - 1;
+    memcpy((char *) q->data + itemsize * q->head, item, itemsize);
+    return 0;
+}
+
+int janet_q_pop(JanetQueue *q, void *out, size_t itemsize) {
+    if (q->head == q->tail) return 1;
+    memcpy(out, (char *) q->data + itemsize * q->head, itemsize);
+    q->head = q->head + 1 < q->capacity ? q->head + 1 : 0;
+    return 0;
+}
+
+int janet_q_pop_tail(JanetQueue *q, void *out, size_t itemsize) {
+    if (q->head == q->tail) return 1;
+    q->tail = q->tail > 0 ? q->tail - 1 : q->capacity - 1;
+    memcpy(out, (char *) q->data + itemsize * q->tail, itemsize);
+    return 0;
+}
+
+/* Get the address of the nth item from the head. n must be in range. */
+void *janet_q_at(JanetQueue *q, int32_t n, size_t itemsize) {
+    int32_t i = q->head + n;
+    if (i >= q->capacity) i -= q->capacity;
+    return (char *) q->data + itemsize * i;
+}
+
 /* Clock shims for various platforms */
 #ifdef JANET_GETTIME
 /* For macos */
@@ -65,6 +65,7 @@ int32_t janet_tablen(int32_t n);
 void safe_memcpy(void *dest, const void *src, size_t len);
 void janet_buffer_push_types(JanetBuffer *buffer, int types);
 const JanetKV *janet_dict_find(const JanetKV *buckets, int32_t cap, Janet key);
+JanetKV *janet_table_find_next(JanetTable *t, Janet key);
 void janet_memempty(JanetKV *mem, int32_t count);
 void *janet_memalloc_empty(int32_t count);
 JanetTable *janet_get_core_table(const char *name);
@@ -80,7 +81,48 @@ void janet_buffer_format(
     int32_t argstart,
     int32_t argc,
     Janet *argv);
+void janet_buffer_format_value(
+    JanetBuffer *b,
+    Janet format,
+    int32_t argstart,
+    int32_t argc,
+    Janet *argv);
+Janet janet_getformat(const Janet *argv, int32_t n);
+Janet janet_format_compile(JanetString source);
+extern const JanetAbstractType janet_format_type;
+extern const JanetAbstractType janet_range_type;
+Janet janet_range_next(void *p, Janet key);
+Janet janet_range_slice(int32_t argc, Janet *argv);
 Janet janet_next_impl(Janet ds, Janet key, int is_interpreter);
+Janet janet_call_value(Janet callee, int32_t argc, Janet *argv);
+void janet_each(Janet ds, void (*fn)(Janet x, void *data), void *data);
+void janet_gccheck(void);
+void janet_gcrooted(const Janet *roots, int32_t n, void (*fn)(void *data), void *data);
+void janet_each_rooted(const Janet *roots, int32_t n, Janet ds, void (*fn)(Janet x, void *data), void *data);
+
+/* Orderings for sorts and heaps. The core < and > functions are recognized
+ * and compared natively. */
+typedef enum {
+    JANET_SORT_LT,
+    JANET_SORT_GT,
+    JANET_SORT_CALL
+} JanetSortKind;
+typedef struct {
+    JanetSortKind kind;
+    Janet before;
+} JanetSortOrder;
+JanetSortOrder janet_getsortorder(const Janet *argv, int32_t argc, int32_t n);
+int janet_sort_before(const JanetSortOrder *order, Janet x, Janet y);
+
+/* Ring buffer queues */
+void janet_q_init(JanetQueue *q);
+void janet_q_deinit(JanetQueue *q);
+int32_t janet_q_count(JanetQueue *q);
+int janet_q_push(JanetQueue *q, void *item, size_t itemsize);
+int janet_q_push_head(JanetQueue *q, void *item, size_t itemsize);
+int janet_q_pop(JanetQueue *q, void *out, size_t itemsize);
+int janet_q_pop_tail(JanetQueue *q, void *out, size_t itemsize);
+void *janet_q_at(JanetQueue *q, int32_t n, size_t itemsize);
 
 /* Registry functions */
 void janet_registry_put(
@@ -119,6 +161,13 @@ int janet_gettime(struct timespec *spec);
 
 #define RETRY_EINTR(RC, CALL) do { (RC) = CALL; } while((RC) < 0 && errno == EINTR)
 
+/* Ropes flatten into a string when bytes are needed, except for leaves,
+ * which are read in place */
+typedef struct JanetRope JanetRope;
+extern const JanetAbstractType janet_rope_type;
+JanetString janet_rope_flatten(JanetRope *r);
+const uint8_t *janet_rope_bytes(JanetRope *r, int32_t *len);
+
 /* Initialize builtin libraries */
 void janet_lib_io(JanetTable *env);
 void janet_lib_math(JanetTable *env);
@@ -130,6 +179,14 @@ void janet_lib_fiber(JanetTable *env);
 void janet_lib_os(JanetTable *env);
 void janet_lib_string(JanetTable *env);
 void janet_lib_marsh(JanetTable *env);
+void janet_lib_persistent(JanetTable *env);
+void janet_lib_rope(JanetTable *env);
+void janet_lib_deque(JanetTable *env);
+void janet_lib_heap(JanetTable *env);
+void janet_lib_set(JanetTable *env);
+void janet_lib_iter(JanetTable *env);
+void janet_lib_range(JanetTable *env);
+void janet_lib_record(JanetTable *env);
 void janet_lib_parse(JanetTable *env);
 #ifdef JANET_ASSEMBLER
 void janet_lib_asm(JanetTable *env);
@@ -126,7 +126,7 @@ Janet janet_next_impl(Janet ds, Janet key, int is_interpreter) {
             int32_t cap;
             if (t == JANET_TABLE) {
                 JanetTable *tab = janet_unwrap_table(ds);
-                cap = tab->capacity;
+                cap = tab->count + tab->deleted;
                 start = tab->data;
             } else {
                 JanetStruct st = janet_unwrap_struct(ds);
@@ -136,7 +136,11 @@ Janet janet_next_impl(Janet ds, Janet key, int is_interpreter) {
             const JanetKV *end = start + cap;
             const JanetKV *kv = janet_checktype(key, JANET_NIL)
                                 ? start
-                                : janet_dict_find(start, cap, key) + 1;
+                                : (t == JANET_TABLE
+                                   ? janet_table_find_next(janet_unwrap_table(ds), key)
+                                   : janet_dict_find(start, cap, key));
+            if (NULL == kv) break;
+            if (!janet_checktype(key, JANET_NIL)) kv++;
             while (kv < end) {
                 if (!janet_checktype(kv->key, JANET_NIL)) return kv->key;
                 kv++;
@@ -231,7 +235,29 @@ static int janet_compare_abstract(JanetAbstract xx, JanetAbstract yy) {
     if (xt->compare == NULL) {
         return xx > yy ? 1 : -1;
     }
-    return xt->compare(xx, yy);
+    /* Compare hooks of container types call back into janet_equals and
+     * janet_compare, which start over from the bottom of the traversal stack.
+     * Give them a stack of their own while a traversal is in progress. */
+    JanetTraversalNode *traversal = janet_vm.traversal;
+    if (traversal == NULL || traversal == janet_vm.traversal_base) {
+        int result = xt->compare(xx, yy);
+        janet_vm.traversal = janet_vm.traversal_base;
+        return result;
+    }
+    JanetTraversalNode *base = janet_vm.traversal_base;
+    JanetTraversalNode *top = janet_vm.traversal_top;
+    janet_vm.traversal = janet_vm.traversal_base = janet_vm.traversal_top = NULL;
+    int result = 0;
+    JanetTryState tstate;
+    JanetSignal signal = janet_try(&tstate);
+    if (!signal) result = xt->compare(xx, yy);
+    janet_restore(&tstate);
+    janet_free(janet_vm.traversal_base);
+    janet_vm.traversal = traversal;
+    janet_vm.traversal_base = base;
+    janet_vm.traversal_top = top;
+    if (signal) janet_panicv(tstate.payload);
+    return result;
 }
 
 int janet_equals(Janet x, Janet y) {
@@ -281,6 +307,17 @@ int janet_equals(Janet x, Janet y) {
     return 1;
 }
 
+/* Mix all 64 bits of a number or pointer into a 32 bit hash
+ * (the murmur3 finalizer) */
+static int32_t janet_hash_mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+    return (int32_t)(uint32_t) x;
+}
+
 /* Computes a hash value for a function */
 int32_t janet_hash(Janet x) {
     int32_t hash = 0;
@@ -294,7 +331,8 @@ int32_t janet_hash(Janet x) {
         case JANET_STRING:
         case JANET_SYMBOL:
         case JANET_KEYWORD:
-            hash = janet_string_hash(janet_unwrap_string(x));
+            hash = janet_string_head(janet_unwrap_string(x))->hash;
+            if (!hash) hash = janet_string_gethash(janet_unwrap_string(x));
             break;
         case JANET_TUPLE:
             hash = janet_tuple_hash(janet_unwrap_tuple(x));
@@ -308,9 +346,9 @@ int32_t janet_hash(Janet x) {
                 uint64_t u;
             } as;
             as.d = janet_unwrap_number(x);
-            uint32_t lo = (uint32_t)(as.u & 0xFFFFFFFF);
-            uint32_t hi = (uint32_t)(as.u >> 32);
-            hash = (int32_t)(hi ^ (lo >> 3));
+            /* 0 and -0 are equal, so they must hash the same */
+            if (as.d == 0) as.u = 0;
+            hash = janet_hash_mix64(as.u);
             break;
         }
         case JANET_ABSTRACT: {
@@ -325,10 +363,7 @@ int32_t janet_hash(Janet x) {
         default:
             if (sizeof(double) == sizeof(void *)) {
                 /* Assuming 8 byte pointer */
-                uint64_t i = janet_u64(x);
-                uint32_t lo = (uint32_t)(i & 0xFFFFFFFF);
-                uint32_t hi = (uint32_t)(i >> 32);
-                hash = (int32_t)(hi ^ (lo >> 3));
+                hash = janet_hash_mix64(janet_u64(x));
             } else {
                 /* Assuming 4 byte pointer (or smaller) */
                 hash = (int32_t)((char *)janet_unwrap_pointer(x) - (char *)0);
@@ -627,6 +662,9 @@ int32_t janet_length(Janet x) {
         case JANET_TABLE:
             return janet_unwrap_table(x)->count;
         case JANET_ABSTRACT: {
+            JanetAbstract abst = janet_unwrap_abstract(x);
+            const JanetAbstractType *at = janet_abstract_type(abst);
+            if (at->length != NULL) return at->length(abst, janet_abstract_size(abst));
             Janet argv[1] = { x };
             Janet len = janet_mcall("length", 1, argv);
             if (!janet_checkint(len))
@@ -655,6 +693,9 @@ Janet janet_lengthv(Janet x) {
         case JANET_TABLE:
             return janet_wrap_integer(janet_unwrap_table(x)->count);
         case JANET_ABSTRACT: {
+            JanetAbstract abst = janet_unwrap_abstract(x);
+            const JanetAbstractType *at = janet_abstract_type(abst);
+            if (at->length != NULL) return janet_wrap_integer(at->length(abst, janet_abstract_size(abst)));
             Janet argv[1] = { x };
             return janet_mcall("length", 1, argv);
         }
@@ -290,6 +290,18 @@ static Janet resolve_method(Janet name, JanetFiber *fiber) {
     return callee;
 }
 
+/* Call any callable value from C the same way a call instruction would. */
+Janet janet_call_value(Janet callee, int32_t argc, Janet *argv) {
+    if (janet_checktype(callee, JANET_KEYWORD)) {
+        if (argc < 1) janet_panicf("method call (%v) takes at least 1 argument, got 0", callee);
+        Janet method = method_to_fun(callee, argv[0]);
+        if (janet_checktype(method, JANET_NIL))
+            janet_panicf("unknown method %v invoked on %v", callee, argv[0]);
+        callee = method;
+    }
+    return janet_method_invoke(callee, argc, argv);
+}
+
 /* Lookup method on value x */
 static Janet janet_method_lookup(Janet x, const char *name) {
     return method_to_fun(janet_ckeywordv(name), x);
@@ -399,7 +411,7 @@ static JanetSignal run_vm(JanetFiber *fiber, Janet in) {
         &&label_JOP_NOT_EQUALS,
         &&label_JOP_NOT_EQUALS_IMMEDIATE,
         &&label_JOP_CANCEL,
-        &&label_unknown_op,
+        &&label_JOP_JUMP_TABLE,
         &&label_unknown_op,
         &&label_unknown_op,
         &&label_unknown_op,
@@ -796,6 +808,19 @@ static JanetSignal run_vm(JanetFiber *fiber, Janet in) {
     }
     vm_next();
 
+    VM_OP(JOP_JUMP_TABLE) {
+        /* Constant is a struct mapping keys to forward jump offsets,
+         * checked by janet_verify. Fall through on a miss. */
+        const JanetKV *table = janet_unwrap_struct(func->def->constants[E]);
+        Janet offset = janet_struct_get(table, stack[A]);
+        if (janet_checktype(offset, JANET_NUMBER)) {
+            pc += (int32_t) janet_unwrap_number(offset);
+        } else {
+            pc++;
+        }
+        vm_next();
+    }
+
     VM_OP(JOP_LESS_THAN)
     vm_compop( <);
 
@@ -835,6 +860,12 @@ static JanetSignal run_vm(JanetFiber *fiber, Janet in) {
     vm_pcnext();
 
     VM_OP(JOP_NEXT)
+    if (janet_checktype(stack[B], JANET_ABSTRACT)
+            && janet_abstract_type(janet_unwrap_abstract(stack[B])) == &janet_range_type) {
+        /* Ranges never run code, so step them in place */
+        stack[A] = janet_range_next(janet_unwrap_abstract(stack[B]), stack[C]);
+        vm_pcnext();
+    }
     vm_commit();
     {
         Janet temp = janet_next_impl(stack[B], stack[C], 1);
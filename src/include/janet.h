@@ -193,6 +193,11 @@ extern "C" {
 #define JANET_INT_TYPES
 #endif
 
+/* Enable or disable typed arrays of unboxed numbers */
+#ifndef JANET_NO_TYPED_ARRAY
+#define JANET_TYPED_ARRAY
+#endif
+
 /* Enable or disable epoll on Linux */
 #if defined(JANET_LINUX) && !defined(JANET_EV_NO_EPOLL)
 #define JANET_EV_EPOLL
@@ -265,9 +270,14 @@ extern "C" {
 #define JANET_SINGLE_THREADED_BIT 0
 #endif
 
+/* Set by headers where JanetAbstractType has a length field. Native modules
+ * built without it are rejected, since their abstract types are too short. */
+#define JANET_ABSTRACT_LENGTH_BIT 0x4
+
 #define JANET_CURRENT_CONFIG_BITS \
     (JANET_SINGLE_THREADED_BIT | \
-     JANET_NANBOX_BIT)
+     JANET_NANBOX_BIT | \
+     JANET_ABSTRACT_LENGTH_BIT)
 
 /* Represents the settings used to compile Janet, as well as the version */
 typedef struct {
@@ -1086,6 +1096,7 @@ struct JanetAbstractType {
     int32_t (*hash)(void *p, size_t len);
     Janet(*next)(void *p, Janet key);
     Janet(*call)(void *p, int32_t argc, Janet *argv);
+    int32_t (*length)(void *p, size_t len);
 };
 
 /* Some macros to let us add extra types to JanetAbstract types without
@@ -1103,7 +1114,8 @@ struct JanetAbstractType {
 #define JANET_ATEND_COMPARE     NULL,JANET_ATEND_HASH
 #define JANET_ATEND_HASH        NULL,JANET_ATEND_NEXT
 #define JANET_ATEND_NEXT        NULL,JANET_ATEND_CALL
-#define JANET_ATEND_CALL
+#define JANET_ATEND_CALL        NULL,JANET_ATEND_LENGTH
+#define JANET_ATEND_LENGTH
 
 struct JanetReg {
     const char *name;
@@ -1291,6 +1303,7 @@ enum JanetOpCode {
     JOP_NOT_EQUALS,
     JOP_NOT_EQUALS_IMMEDIATE,
     JOP_CANCEL,
+    JOP_JUMP_TABLE,
     JOP_INSTRUCTION_COUNT
 };
 
@@ -1571,11 +1584,12 @@ JANET_API JanetTuple janet_tuple_n(const Janet *values, int32_t n);
 /* String/Symbol functions */
 #define janet_string_head(s) ((JanetStringHead *)((char *)s - offsetof(JanetStringHead, data)))
 #define janet_string_length(s) (janet_string_head(s)->length)
-#define janet_string_hash(s) (janet_string_head(s)->hash)
+#define janet_string_hash(s) janet_string_gethash(s)
 JANET_API uint8_t *janet_string_begin(int32_t length);
 JANET_API JanetString janet_string_end(uint8_t *str);
 JANET_API JanetString janet_string(const uint8_t *buf, int32_t len);
 JANET_API JanetString janet_cstring(const char *cstring);
+JANET_API int32_t janet_string_gethash(JanetString str);
 JANET_API int janet_string_compare(JanetString lhs, JanetString rhs);
 JANET_API int janet_string_equal(JanetString lhs, JanetString rhs);
 JANET_API int janet_string_equalconst(JanetString lhs, const uint8_t *rhs, int32_t rlen, int32_t rhash);
@@ -1628,9 +1642,13 @@ JANET_API void janet_table_put(JanetTable *t, Janet key, Janet value);
 JANET_API JanetStruct janet_table_to_struct(JanetTable *t);
 JANET_API void janet_table_merge_table(JanetTable *table, JanetTable *other);
 JANET_API void janet_table_merge_struct(JanetTable *table, JanetStruct other);
+/* Deprecated, use janet_table_lookup. Returns NULL rather than a free bucket
+ * for missing keys, since new keys must go through janet_table_put. */
 JANET_API JanetKV *janet_table_find(JanetTable *t, Janet key);
+JANET_API JanetKV *janet_table_lookup(JanetTable *t, Janet key);
 JANET_API JanetTable *janet_table_clone(JanetTable *table);
 JANET_API void janet_table_clear(JanetTable *table);
+JANET_API void janet_table_compact(JanetTable *table);
 
 /* Fiber */
 JANET_API JanetFiber *janet_fiber(JanetFunction *callee, int32_t capacity, int32_t argc, const Janet *argv);
@@ -1643,7 +1661,10 @@ JANET_API JanetFiber *janet_root_fiber(void);
 JANET_API int janet_indexed_view(Janet seq, const Janet **data, int32_t *len);
 JANET_API int janet_bytes_view(Janet str, const uint8_t **data, int32_t *len);
 JANET_API int janet_dictionary_view(Janet tab, const JanetKV **data, int32_t *len, int32_t *cap);
+/* Table views are in insertion order rather than hashed, so janet_dictionary_get
+ * scans them linearly. Use janet_dictionary_rawget on the table or struct. */
 JANET_API Janet janet_dictionary_get(const JanetKV *data, int32_t cap, Janet key);
+JANET_API Janet janet_dictionary_rawget(Janet dict, Janet key);
 JANET_API const JanetKV *janet_dictionary_next(const JanetKV *kvs, int32_t cap, const JanetKV *kv);
 
 /* Abstract */
@@ -1701,10 +1722,8 @@ JANET_API int janet_verify(JanetFuncDef *def);
 JANET_API JanetBuffer *janet_pretty(JanetBuffer *buffer, int depth, int flags, Janet x);
 
 /* Misc */
-#ifdef JANET_PRF
 #define JANET_HASH_KEY_SIZE 16
 JANET_API void janet_init_hash_key(uint8_t key[JANET_HASH_KEY_SIZE]);
-#endif
 JANET_API void janet_try_init(JanetTryState *state);
 #if defined(JANET_BSD) || defined(JANET_APPLE)
 #define janet_try(state) (janet_try_init(state), (JanetSignal) _setjmp((state)->buf))